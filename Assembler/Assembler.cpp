@@ -1,36 +1,144 @@
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <stdexcept>
 #include "Parser.h"
+#include "../Common/RomImage.h"
 
 using namespace std;
-char* LexerLoc;
+
+enum class Format { TEXT, RAW, IMAGE };
+
+// One line of 16 binary digits per word
+static string text_output(const vector<bitset<16>>& words)
+{
+    string out(words.size() * 17, '\n');
+    for (size_t i = 0; i < words.size(); ++i)
+        for (int bit = 0; bit < 16; ++bit)
+            out[i * 17 + bit] = words[i].test(15 - bit) ? '1' : '0';
+    return out;
+}
+
+// Little-endian words, no header
+static string raw_output(const vector<bitset<16>>& words)
+{
+    string out(words.size() * 2, '\0');
+    for (size_t i = 0; i < words.size(); ++i)
+    {
+        uint16_t word = (uint16_t)words[i].to_ulong();
+        memcpy(out.data() + 2 * i, &word, 2);
+    }
+    return out;
+}
+
+static string image_output(const Parser& p, const vector<bitset<16>>& words, bool hackx, bool banked)
+{
+    auto align = [](size_t offset) { return (offset + 7) & ~size_t{ 7 }; };
+
+    vector<ROM_IMAGE_SYMBOL> symbols;
+    string names;
+    for (auto& [address, name] : p.labels())
+    {
+        symbols.push_back({ (uint32_t)names.size(), (uint16_t)address, ROM_IMAGE_LABEL });
+        names.append(name).push_back('\0');
+    }
+    for (auto& [name, address] : p.variables())
+    {
+        symbols.push_back({ (uint32_t)names.size(), (uint16_t)address, ROM_IMAGE_VARIABLE });
+        names.append(name).push_back('\0');
+    }
+    vector<uint32_t> lines;
+    for (int line : p.source_lines())
+        lines.push_back(line);
+
+    ROM_IMAGE_HEADER header{};
+    memcpy(header.magic, ROM_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = ROM_IMAGE_VERSION;
+    header.flags = (hackx ? ROM_IMAGE_HACKX : 0) | (banked ? ROM_IMAGE_BANKED : 0);
+    header.words = { (uint32_t)align(sizeof(header)), (uint32_t)words.size() };
+    header.symbols = { (uint32_t)align(header.words.offset + 2 * words.size()), (uint32_t)symbols.size() };
+    header.names = { (uint32_t)align(header.symbols.offset + sizeof(ROM_IMAGE_SYMBOL) * symbols.size()), (uint32_t)names.size() };
+    header.lines = { (uint32_t)align(header.names.offset + names.size()), (uint32_t)lines.size() };
+
+    string out(header.lines.offset + 4 * lines.size(), '\0');
+    memcpy(out.data(), &header, sizeof(header));
+    string words_raw = raw_output(words);
+    memcpy(out.data() + header.words.offset, words_raw.data(), words_raw.size());
+    memcpy(out.data() + header.symbols.offset, symbols.data(), sizeof(ROM_IMAGE_SYMBOL) * symbols.size());
+    memcpy(out.data() + header.names.offset, names.data(), names.size());
+    memcpy(out.data() + header.lines.offset, lines.data(), 4 * lines.size());
+    return out;
+}
 
 int main(int argc, char** argv)
 {
-    if (argc != 4)
+    bool hackx = false;
+    bool banked = false;
+    Format format = Format::TEXT;
+    int threads = 1;
+    string cache;
+    while (argc > 3 && string(argv[1]).starts_with("--"))
+    {
+        string flag = argv[1];
+        if (flag == "--isa=hackx")
+            hackx = true;
+        else if (flag == "--banked")
+            banked = true;
+        else if (flag == "--format=text")
+            format = Format::TEXT;
+        else if (flag == "--format=raw")
+            format = Format::RAW;
+        else if (flag == "--format=image")
+            format = Format::IMAGE;
+        else if (flag.starts_with("--threads="))
+            threads = max(atoi(flag.c_str() + 10), 1);
+        else if (flag.starts_with("--cache="))
+            cache = flag.substr(8);
+        else
+            break;
+        argv++;
+        argc--;
+    }
+
+    if (argc != 3)
     {
         cerr << "Invalid number of arguments!" << endl;
-        cerr << "Usage: ./assembler.out <DFA file> <input_assembly_location> <output_file_location>" << endl;
+        cerr << "Usage: ./assembler.out [--isa=hackx] [--banked] [--format=text|raw|image] [--threads=N] [--cache=path] <input_assembly_location> <output_file_location>" << endl;
         exit(-1);
     }
 
-    LexerLoc = argv[1];
-    loadDFA();
-
-    Buffer buffer(argv[2]);
-
-    Parser p(buffer);
-    auto b = p.convert_to_binary();
-    ofstream output_file{ argv[3] };
-    
-    if (!output_file)
+    // the simulator tells raw words from text by the .bin suffix
+    bool bin_suffix = string(argv[2]).ends_with(".bin");
+    if ((format == Format::RAW && !bin_suffix) || (format == Format::TEXT && bin_suffix))
     {
-        cerr << "Error opening output file for binary!" << endl;
+        cerr << "Raw output files, and only those, must end in .bin" << endl;
         exit(-1);
     }
 
-    for (auto& x : b)
-        output_file << x << endl;
+    Buffer buffer(argv[1]);
+
+    try
+    {
+        Parser p(buffer, hackx, banked, threads, cache);
+        auto& b = p.convert_to_binary();
+        ofstream output_file{ argv[2], ios::binary };
+
+        if (!output_file)
+        {
+            cerr << "Error opening output file for binary!" << endl;
+            exit(-1);
+        }
 
-    p.print_symbol_table();
-}
\ No newline at end of file
+        string output = format == Format::TEXT ? text_output(b) :
+                        format == Format::RAW ? raw_output(b) :
+                        image_output(p, b, hackx, banked);
+        output_file.write(output.data(), output.size());
+
+        p.print_symbol_table();
+    }
+    catch (const runtime_error& e)
+    {
+        cerr << e.what() << endl;
+        exit(-1);
+    }
+}
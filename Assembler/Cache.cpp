@@ -0,0 +1,187 @@
+#include "Cache.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <unordered_set>
+using namespace std;
+
+// Cache file, host byte order:
+//   magic | version | flags | checksum: u64, hash of the entries | entries, each
+//   hash: u64 | size newlines lines words labels references names: u32 | text: size bytes |
+//   words: u16 each | labels, references: (line, symbol) u32 pairs | names: u32 length + bytes each
+namespace
+{
+    constexpr char CACHE_MAGIC[8] = { 'H', 'A', 'C', 'K', 'A', 'S', 'M', 'C' };
+    constexpr uint32_t CACHE_VERSION = 2;
+
+    struct READER
+    {
+        string_view data;
+        bool ok = true;
+
+        template <typename T> T get()
+        {
+            T value{};
+            if (data.size() < sizeof(T))
+                ok = false;
+            else
+            {
+                memcpy(&value, data.data(), sizeof(T));
+                data.remove_prefix(sizeof(T));
+            }
+            return value;
+        }
+
+        string_view bytes(uint32_t count)
+        {
+            if (data.size() < count)
+            {
+                ok = false;
+                return {};
+            }
+            string_view value = data.substr(0, count);
+            data.remove_prefix(count);
+            return value;
+        }
+    };
+
+    template <typename T> void put(string& out, T value)
+    {
+        out.append((const char*)&value, sizeof(T));
+    }
+}
+
+uint64_t REGION_CACHE::hash(string_view text)
+{
+    // FNV-1a
+    uint64_t hash = 0xCBF29CE484222325u;
+    for (unsigned char c : text)
+        hash = (hash ^ c) * 0x100000001B3u;
+    return hash;
+}
+
+REGION_CACHE::REGION_CACHE(const string& path, uint32_t flags)
+{
+    ifstream file{ path, ios::binary };
+    if (!file)
+        return;
+    contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+
+    READER in{ contents };
+    if (in.bytes(sizeof(CACHE_MAGIC)) != string_view(CACHE_MAGIC, sizeof(CACHE_MAGIC)) ||
+        in.get<uint32_t>() != CACHE_VERSION || in.get<uint32_t>() != flags)
+        return;
+    uint64_t checksum = in.get<uint64_t>();
+    if (!in.ok || checksum != hash(in.data))
+        return;
+
+    while (in.ok && !in.data.empty())
+    {
+        uint64_t key = in.get<uint64_t>();
+        uint32_t size = in.get<uint32_t>();
+        ENTRY entry;
+        REGION& region = entry.region;
+        region.newlines = (int)in.get<uint32_t>();
+        region.lines = (int)in.get<uint32_t>();
+        uint32_t words = in.get<uint32_t>();
+        uint32_t labels = in.get<uint32_t>();
+        uint32_t references = in.get<uint32_t>();
+        uint32_t names = in.get<uint32_t>();
+
+        // counts are bounded by what is left of the file before anything is allocated
+        if (!in.ok || words != (uint32_t)region.lines || region.lines < 0 || region.newlines < 0 ||
+            words > in.data.size() / 2 || labels > in.data.size() / 8 ||
+            references > in.data.size() / 8 || names > in.data.size() / 4)
+            break;
+
+        entry.text = in.bytes(size);
+        region.words.resize(words);
+        for (auto& word : region.words)
+            word = in.get<uint16_t>();
+        for (auto* list : { &region.labels, &region.references })
+        {
+            list->resize(list == &region.labels ? labels : references);
+            for (auto& [line, symbol] : *list)
+            {
+                line = (int)in.get<uint32_t>();
+                symbol = (int)in.get<uint32_t>();
+                if (line < 0 || line >= region.lines || symbol < 0 || symbol >= (int)names)
+                    in.ok = false;
+            }
+        }
+        for (uint32_t i = 0; i < names && in.ok; ++i)
+            region.names.push_back(in.bytes(in.get<uint32_t>()));
+
+        if (!in.ok)
+            break;
+        entries.emplace(key, move(entry));
+    }
+
+    // a damaged cache is dropped whole
+    if (!in.ok)
+        entries.clear();
+}
+
+const REGION* REGION_CACHE::find(string_view text) const
+{
+    auto entry = entries.find(hash(text));
+    if (entry == entries.end() || entry->second.text != text)
+        return nullptr;
+    return &entry->second.region;
+}
+
+void REGION_CACHE::save(const string& path, uint32_t flags, const vector<pair<string_view, const REGION*>>& regions)
+{
+    string out(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    put(out, CACHE_VERSION);
+    put(out, flags);
+    size_t checksum = out.size();
+    put(out, uint64_t{ 0 });
+
+    unordered_set<uint64_t> written;
+    for (auto& [text, region] : regions)
+    {
+        uint64_t key = hash(text);
+        if (!written.insert(key).second)
+            continue;
+
+        put(out, key);
+        put(out, (uint32_t)text.size());
+        put(out, (uint32_t)region->newlines);
+        put(out, (uint32_t)region->lines);
+        put(out, (uint32_t)region->words.size());
+        put(out, (uint32_t)region->labels.size());
+        put(out, (uint32_t)region->references.size());
+        put(out, (uint32_t)region->names.size());
+        out.append(text);
+        for (uint16_t word : region->words)
+            put(out, word);
+        for (auto* list : { &region->labels, &region->references })
+            for (auto& [line, symbol] : *list)
+            {
+                put(out, (uint32_t)line);
+                put(out, (uint32_t)symbol);
+            }
+        for (auto name : region->names)
+        {
+            put(out, (uint32_t)name.size());
+            out.append(name);
+        }
+    }
+
+    uint64_t sum = hash(string_view(out).substr(checksum + sizeof(uint64_t)));
+    memcpy(out.data() + checksum, &sum, sizeof(sum));
+
+    // written aside and renamed over the old cache, so an interrupted run never leaves half a file
+    string temporary = path + ".tmp";
+    ofstream file{ temporary, ios::binary };
+    file.write(out.data(), out.size());
+    file.close();
+    if (!file || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        cerr << "Cannot write cache " << path << endl;
+        remove(temporary.c_str());
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Pass 1 result for a region of whole source lines: everything the assembler needs from it once
+// labels and variables are resolved, independent of where the region sits in the file
+struct REGION
+{
+    int newlines = 0;
+    int lines = 0;                                  // lines that produce a word
+    std::vector<uint16_t> words;                    // one per line, @SYMBOL lines hold 0
+    std::vector<std::pair<int, int>> labels;        // (line in region, symbol) of each label definition
+    std::vector<std::pair<int, int>> references;    // (line in region, symbol) of each @SYMBOL
+    std::vector<std::string_view> names;            // symbol -> name
+};
+
+// On-disk cache of regions keyed by a hash of their text, for incremental re-assembly. Each
+// region keeps its text, a hit is only taken when the text matches. A missing or unreadable
+// cache, or one written with other flags, loads empty. Names and texts of loaded regions point
+// into the cache contents.
+class REGION_CACHE
+{
+    struct ENTRY
+    {
+        std::string_view text;                      // compared in full before the region is reused
+        REGION region;
+    };
+
+    std::string contents;
+    std::unordered_map<uint64_t, ENTRY> entries;
+
+    static uint64_t hash(std::string_view text);
+
+public:
+    REGION_CACHE(const std::string& path, uint32_t flags);
+    REGION_CACHE(const REGION_CACHE&) = delete;
+    REGION_CACHE& operator=(const REGION_CACHE&) = delete;
+
+    const REGION* find(std::string_view text) const;
+
+    // Replaces the cache with the given (text, region) pairs
+    static void save(const std::string& path, uint32_t flags,
+                     const std::vector<std::pair<std::string_view, const REGION*>>& regions);
+};
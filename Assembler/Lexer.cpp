@@ -1,10 +1,14 @@
 #include "Lexer.h"
+#include "DFA.h"
 #include <cassert>
 #include <iomanip>
-#include <sstream>
+#include <charconv>
 using namespace std;
 
-DFA dfa;
+const DFA dfa{
+	{ DFA_TOKEN_NAMES.begin(), DFA_TOKEN_NAMES.end() },
+	{ DFA_KEYWORD_TOKENS.begin(), DFA_KEYWORD_TOKENS.end() },
+};
 
 std::ostream& operator<< (std::ostream& out, const Token& token)
 {
@@ -25,118 +29,41 @@ std::ostream& operator<< (std::ostream& out, const Token& token)
 	return out;
 }
 
-void loadDFA()
+// Fills in the lexeme and refines the type, false for tokens the parser never sees
+static bool onTokenFromDFA(Token& token, const Buffer& buffer)
 {
-	std::ifstream dfaReader{ LexerLoc };
-	assert(dfaReader);
-	dfaReader >> dfa.num_tokens >> dfa.num_states >> dfa.num_transitions >> dfa.num_finalStates >> dfa.num_keywords;
-
-	// Load Tokens
-	dfa.tokenType2tokenStr.clear();
-	dfa.tokenType2tokenStr.resize(dfa.num_tokens);
-	dfa.tokenStr2tokenType.clear();
-	for (int i = 0; i < dfa.num_tokens; ++i)
-	{
-		dfaReader >> dfa.tokenType2tokenStr[i];
-		dfa.tokenStr2tokenType[dfa.tokenType2tokenStr[i]] = (TokenType)i;
-	}
-
-	// Load Transitions
-	dfa.productions.clear();
-	dfa.productions.assign(dfa.num_states, vector<int>(128, -1));
-
-	for (int i = 0; i < dfa.num_transitions; ++i)
-	{
-		int from, to;
-		string symbols;
-		dfaReader >> from >> to >> symbols;
-
-		for (char c : symbols)
-			dfa.productions[from][c] = to;
-	}
-
-	// state 12 - accept state for comment
-	for (int i = 0; i < 128; i++)
-		dfa.productions[12][i] = 12;
-
-	dfa.productions[12]['\n'] = -1;
-
-	// state 13 - accept state for whitespace
-	dfa.productions[0][' ']
-		= dfa.productions[0]['\t']
-		= dfa.productions[0]['\r']
-		= dfa.productions[13][' ']
-		= dfa.productions[13]['\t']
-		= dfa.productions[13]['\r']
-		= 13;
-
-	// Load Final States
-	dfa.finalStates.clear();
-	dfa.finalStates.assign(dfa.num_states, TokenType::UNINITIALISED);
-
-	for (int i = 0; i < dfa.num_finalStates; i++)
-	{
-		int state;
-		string BUFF;
-		dfaReader >> state >> BUFF;
-
-		dfa.finalStates[state] = dfa.tokenStr2tokenType[BUFF];
-	}
-
-	// Load Keywords
-	dfa.lookupTable.clear();
-	dfa.keywordTokens.clear();
-	for (int i = 0; i < dfa.num_keywords; ++i)
-	{
-		string keyword, token_name;
-		dfaReader >> keyword >> token_name;
-		dfa.lookupTable[keyword] = dfa.tokenStr2tokenType[token_name];
-		dfa.keywordTokens.insert(token_name);
-	}
-}
+	if (token.type == TokenType::TK_COMMENT || token.type == TokenType::TK_WHITESPACE)
+		return false;
 
-void onTokenFromDFA(Token*& token, Buffer& buffer)
-{
-	if (token->type == TokenType::TK_COMMENT || token->type == TokenType::TK_WHITESPACE)
-	{
-		delete token;
-		token = nullptr;
-		return;
-	}
+	token.lexeme = buffer.view(token.start_index, token.length);
 
-	char* BUFF = new char[token->length + 1];
-	for (int i = 0; i < token->length; i++)
-		BUFF[i] = buffer.getChar(buffer.start_index - token->length + i);
-	BUFF[token->length] = 0;
-	token->lexeme = BUFF;
-
-	if (token->type == TokenType::TK_SYMBOL)
+	if (token.type == TokenType::TK_SYMBOL)
 	{
-		auto res = dfa.lookupTable.find(token->lexeme);
-		if (res != dfa.lookupTable.end())
-			token->type = dfa.lookupTable.at(token->lexeme);
+		TokenType keyword = lookupKeyword(token.lexeme);
+		if (keyword != TokenType::UNINITIALISED)
+			token.type = keyword;
 	}
 
-	if (token->type == TokenType::TK_SYMBOL && token->length > 50)
-		token->type = TokenType::TK_ERROR_LENGTH;
+	if (token.type == TokenType::TK_SYMBOL && token.length > 50)
+		token.type = TokenType::TK_ERROR_LENGTH;
 
-	if (token->type == TokenType::TK_NUM)
+	if (token.type == TokenType::TK_NUM)
 	{
 		// make sure it fits in 15 bits
-		if (token->lexeme.size() > 5)
-			token->type = TokenType::TK_ERROR_LENGTH;
-		else 
+		if (token.lexeme.size() > 5)
+			token.type = TokenType::TK_ERROR_LENGTH;
+		else
 		{
-			stringstream sstr{ token->lexeme };
-			int x;
-			sstr >> x;
+			int x = 0;
+			from_chars(token.lexeme.data(), token.lexeme.data() + token.lexeme.size(), x);
 			if (x > 32767)
-				token->type = TokenType::TK_ERROR_LENGTH;
+				token.type = TokenType::TK_ERROR_LENGTH;
 		}
 	}
+	return true;
 }
 
-Token* getTokenFromDFA(Buffer& buffer)
+static Token getTokenFromDFA(const Buffer& buffer)
 {
 	TokenType ttype;
 	int start_index = buffer.start_index;
@@ -150,34 +77,32 @@ Token* getTokenFromDFA(Buffer& buffer)
 
 	while (true)
 	{
-		char input = buffer.getChar(start_index);
+		unsigned char input = buffer.getChar(start_index);
 
 		last_final = cur_state;
-		ttype = dfa.finalStates[cur_state];
+		ttype = DFA_FINAL[cur_state];
 		input_final_pos = start_index - 1;
 
-		cur_state = dfa.productions[cur_state][input];
+		cur_state = DFA_NEXT[cur_state][DFA_CHAR_CLASS[input]];
 
 		if (cur_state == -1)    // return
 		{
+			Token token;
 			if (input_final_pos == start_index - len - 1)
 			{
-				Token* token = new Token;
-				token->type = TokenType::TK_ERROR_SYMBOL;
-				token->length = 1;
-				return token;
+				token.type = TokenType::TK_ERROR_SYMBOL;
+				token.length = 1;
 			}
-			if (dfa.finalStates[last_final] == TokenType::UNINITIALISED && last_final != 0)
+			else if (DFA_FINAL[last_final] == TokenType::UNINITIALISED && last_final != 0)
 			{
-				Token* token = new Token;
-				token->type = TokenType::TK_ERROR_PATTERN;
-				token->length = len;
-				return token;
+				token.type = TokenType::TK_ERROR_PATTERN;
+				token.length = len;
+			}
+			else
+			{
+				token.type = ttype;
+				token.length = input_final_pos - (start_index - len) + 1;
 			}
-
-			Token* token = new Token;
-			token->type = ttype;
-			token->length = input_final_pos - (start_index - len) + 1;
 			return token;
 		}
 
@@ -189,36 +114,28 @@ Token* getTokenFromDFA(Buffer& buffer)
 	assert(false);
 }
 
-Token* getNextToken(Buffer& buffer)
+Token getNextToken(Buffer& buffer)
 {
 	while (buffer.getTopChar() != '\0')
 	{
 		if (buffer.getTopChar() == '\n')
 		{
-			buffer.line_number++;
-			buffer.start_index++;
+			buffer.advance(1);
 			continue;
 		}
 
-		Token* token = getTokenFromDFA(buffer);
-
-		assert(token != nullptr);
-
-		token->start_index = buffer.start_index;
-		token->line_number = buffer.line_number;
-
-		buffer.start_index += token->length;
+		Token token = getTokenFromDFA(buffer);
+		token.start_index = buffer.start_index;
+		token.line_number = buffer.line_number;
 
-		onTokenFromDFA(token, buffer);
+		buffer.advance(token.length);
 
-		if (token == nullptr)
-			continue;
-
-		return token;
+		if (onTokenFromDFA(token, buffer))
+			return token;
 	}
 
-	Token* end = new Token;
-	end->type = TokenType::TK_EOF;
-	end->line_number = buffer.line_number;
+	Token end;
+	end.type = TokenType::TK_EOF;
+	end.line_number = buffer.line_number;
 	return end;
-}
\ No newline at end of file
+}
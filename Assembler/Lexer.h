@@ -1,13 +1,13 @@
 #pragma once
-#include "Buffer.h"
+#include "../Common/Buffer.h"
+#include <cassert>
 #include <fstream>
 #include <set>
 #include <string>
+#include <string_view>
 #include <map>
 #include <vector>
 
-extern char* LexerLoc;
-
 enum class TokenType
 {
 	TK_OB,
@@ -46,6 +46,11 @@ enum class TokenType
 	TK_REG,
 	TK_SCREEN,
 	TK_KBD,
+	TK_SHL,
+	TK_SHR,
+	TK_MUL,
+	TK_MOVE,
+	TK_BANK,
 	TK_EOF,
 	TK_ERROR_SYMBOL,
 	TK_ERROR_PATTERN,
@@ -53,39 +58,27 @@ enum class TokenType
 	UNINITIALISED
 };
 
+// Tokens are plain values: the lexeme is a view into the source Buffer, which has to
+// outlive them
 struct Token
 {
 	TokenType type = TokenType::UNINITIALISED;
-	std::string lexeme;
+	std::string_view lexeme;
 	int line_number = 0;
 	int start_index = 0;
 	int length = 0;
+	int symbol = -1;			// interned id of a TK_SYMBOL, set by the Parser
 
 	friend std::ostream& operator<<(std::ostream&, const Token&);
 };
 
+// Token names and the tokens keywords map to, from the DFA.txt the lexer is generated from
 struct DFA
 {
-	int num_tokens;
-	int num_states;
-	int num_transitions;
-	int num_finalStates;
-	int num_keywords;
-
-	std::vector<std::vector<int>> productions;
-	std::vector<TokenType> finalStates;
 	std::vector<std::string> tokenType2tokenStr;
-	std::map<std::string, TokenType> tokenStr2tokenType;
-	std::map<std::string, TokenType> lookupTable;
 	std::set<std::string> keywordTokens;
-
-	DFA() : num_tokens{ 0 }, num_states{ 0 }, num_transitions{ 0 }, num_finalStates{ 0 }, num_keywords{ 0 }
-	{
-
-	}
 };
 
-extern DFA dfa;
+extern const DFA dfa;
 
-void loadDFA();
-Token* getNextToken(Buffer&);
\ No newline at end of file
+Token getNextToken(Buffer&);
\ No newline at end of file
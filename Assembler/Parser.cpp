@@ -1,14 +1,139 @@
 #include "Parser.h"
 #include <iostream>
-#include <sstream>
+#include <charconv>
+#include <functional>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
 #include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 using namespace std;
 
 map<TokenType, unsigned short> Parser::predefined;
-map<string, bitset<7>> Parser::comp_map;
-map<TokenType, bitset<3>> Parser::jmp_map;
 
+namespace
+{
+    // A comp field is at most three tokens, each coded in 4 bits; the codes packed in token
+    // order form its key, 0 is no token
+    enum COMP_CODE : uint16_t { ZERO = 1, ONE, D, A, M, PLUS, MINUS, AND, OR, NOT, SHL, SHR, MUL };
+
+    constexpr uint16_t comp_key(string_view text)
+    {
+        uint16_t key = 0;
+        for (int i = 0, shift = 0; i < text.size(); ++i, shift += 4)
+        {
+            uint16_t code = 0;
+            switch (text[i])
+            {
+            case '0': code = ZERO; break;
+            case '1': code = ONE; break;
+            case 'D': code = D; break;
+            case 'A': code = A; break;
+            case 'M': code = M; break;
+            case '+': code = PLUS; break;
+            case '-': code = MINUS; break;
+            case '&': code = AND; break;
+            case '|': code = OR; break;
+            case '!': code = NOT; break;
+            case '<': code = SHL; ++i; break;
+            case '>': code = SHR; ++i; break;
+            case '*': code = MUL; break;
+            }
+            key |= code << shift;
+        }
+        return key;
+    }
+
+    struct COMP
+    {
+        string_view text;
+        uint8_t bits;       // a c1..c6
+        bool hackx;         // HackX extension, only accepted with --isa=hackx
+    };
+
+    constexpr COMP COMPS[] = {
+        { "0", 0b0'101010 }, { "1", 0b0'111111 }, { "-1", 0b0'111010 },
+        { "D", 0b0'001100 }, { "A", 0b0'110000 }, { "!D", 0b0'001101 }, { "!A", 0b0'110001 },
+        { "-D", 0b0'001111 }, { "-A", 0b0'110011 }, { "D+1", 0b0'011111 }, { "A+1", 0b0'110111 },
+        { "D-1", 0b0'001110 }, { "A-1", 0b0'110010 }, { "D+A", 0b0'000010 }, { "D-A", 0b0'010011 },
+        { "A-D", 0b0'000111 }, { "D&A", 0b0'000000 }, { "D|A", 0b0'010101 },
+
+        { "M", 0b1'110000 }, { "!M", 0b1'110001 }, { "-M", 0b1'110011 }, { "M+1", 0b1'110111 },
+        { "M-1", 0b1'110010 }, { "D+M", 0b1'000010 }, { "D-M", 0b1'010011 }, { "M-D", 0b1'000111 },
+        { "D&M", 0b1'000000 }, { "D|M", 0b1'010101 },
+
+        { "D<<1", 0b0'000001, true }, { "D>>1", 0b0'000011, true }, { "A<<1", 0b0'000100, true },
+        { "A>>1", 0b0'000101, true }, { "D*A", 0b0'000110, true },
+        { "M<<1", 0b1'000100, true }, { "M>>1", 0b1'000101, true }, { "D*M", 0b1'000110, true },
+    };
+
+    // Multiplicative hash into COMP_SLOTS slots, the multiplier is searched at compile time
+    // so that no two comp keys collide
+    constexpr int COMP_SLOT_BITS = 7;
+    constexpr int COMP_SLOTS = 1 << COMP_SLOT_BITS;
+
+    constexpr int comp_slot(uint16_t key, uint32_t multiplier)
+    {
+        return (uint32_t)(key * multiplier) >> (32 - COMP_SLOT_BITS);
+    }
+
+    constexpr uint32_t comp_multiplier()
+    {
+        // candidates from an LCG: neighbouring odd multipliers hash small keys almost alike
+        for (uint32_t multiplier = 0x9E3779B1u;; multiplier = (multiplier * 747796405u + 2891336453u) | 1)
+        {
+            bool used[COMP_SLOTS]{};
+            bool perfect = true;
+            for (auto& comp : COMPS)
+            {
+                int slot = comp_slot(comp_key(comp.text), multiplier);
+                perfect = perfect && !used[slot];
+                used[slot] = true;
+            }
+            if (perfect)
+                return multiplier;
+        }
+    }
+
+    constexpr uint32_t COMP_MULTIPLIER = comp_multiplier();
+
+    struct COMP_ENTRY
+    {
+        uint16_t key;       // 0 for an empty slot
+        uint8_t bits;
+        bool hackx;
+    };
+
+    constexpr array<COMP_ENTRY, COMP_SLOTS> COMP_TABLE = [] {
+        array<COMP_ENTRY, COMP_SLOTS> table{};
+        for (auto& comp : COMPS)
+            table[comp_slot(comp_key(comp.text), COMP_MULTIPLIER)] = { comp_key(comp.text), comp.bits, comp.hackx };
+        return table;
+    }();
+
+    uint16_t comp_code(const Token& token)
+    {
+        switch (token.type)
+        {
+        case TokenType::TK_NUM: return token.lexeme == "0" ? ZERO : token.lexeme == "1" ? ONE : 0;
+        case TokenType::TK_D: return D;
+        case TokenType::TK_A: return A;
+        case TokenType::TK_M: return M;
+        case TokenType::TK_PLUS: return PLUS;
+        case TokenType::TK_MINUS: return MINUS;
+        case TokenType::TK_AND: return AND;
+        case TokenType::TK_OR: return OR;
+        case TokenType::TK_NOT: return NOT;
+        case TokenType::TK_SHL: return SHL;
+        case TokenType::TK_SHR: return SHR;
+        case TokenType::TK_MUL: return MUL;
+        default: return 0;
+        }
+    }
+}
 
 void Parser::initialise_maps_if_empty()
 {
@@ -22,343 +147,731 @@ void Parser::initialise_maps_if_empty()
         predefined[TokenType::TK_SCREEN] = 0x4000;
         predefined[TokenType::TK_KBD] = 0x6000;
     }
+}
+
+span<const Token> Parser::line(int index) const
+{
+    return { tokens.data() + line_start[index], tokens.data() + line_start[index + 1] };
+}
+
+string Parser::code_of(span<const Token> line) const
+{
+    string code;
+    for (auto& x : line)
+        code.append(x.lexeme).push_back(' ');
+    return code;
+}
 
-    if (jmp_map.size() == 0)
+int SYMBOL_TABLE::intern(string_view name)
+{
+    // keep the table at most half full
+    if (2 * (names.size() + 1) > slots.size())
     {
-        jmp_map[TokenType::TK_JGT] = 0b001;
-        jmp_map[TokenType::TK_JEQ] = 0b010;
-        jmp_map[TokenType::TK_JGE] = 0b011;
-        jmp_map[TokenType::TK_JLT] = 0b100;
-        jmp_map[TokenType::TK_JNE] = 0b101;
-        jmp_map[TokenType::TK_JLE] = 0b110;
-        jmp_map[TokenType::TK_JMP] = 0b111;
+        slots.assign(max<size_t>(1024, 2 * slots.size()), -1);
+        size_t mask = slots.size() - 1;
+        for (int id = 0; id < names.size(); ++id)
+        {
+            size_t slot = hash<string_view>{}(names[id]) & mask;
+            while (slots[slot] != -1)
+                slot = (slot + 1) & mask;
+            slots[slot] = id;
+        }
     }
 
-    if (comp_map.size() == 0)
+    size_t mask = slots.size() - 1;
+    for (size_t slot = hash<string_view>{}(name) & mask;; slot = (slot + 1) & mask)
     {
-        comp_map["0"] = 0b0'101010;
-        comp_map["1"] = 0b0'111111;
-        comp_map["-1"] = 0b0'111010;
-        comp_map["D"] = 0b0'001100;
-        comp_map["A"] = 0b0'110000;
-        comp_map["!D"] = 0b0'001101;
-        comp_map["!A"] = 0b0'110001;
-        comp_map["-D"] = 0b0'001111;
-        comp_map["-A"] = 0b0'110011;
-        comp_map["D+1"] = 0b0'011111;
-        comp_map["A+1"] = 0b0'110111;
-        comp_map["D-1"] = 0b0'001110;
-        comp_map["A-1"] = 0b0'110010;
-        comp_map["D+A"] = 0b0'000010;
-        comp_map["D-A"] = 0b0'010011;
-        comp_map["A-D"] = 0b0'000111;
-        comp_map["D&A"] = 0b0'000000;
-        comp_map["D|A"] = 0b0'010101;
-
-
-        comp_map["M"] = 0b1'110000;
-        comp_map["!M"] = 0b1'110001;
-        comp_map["-M"] = 0b1'110011;
-        comp_map["M+1"] = 0b1'110111;
-        comp_map["M-1"] = 0b1'110010;
-        comp_map["D+M"] = 0b1'000010;
-        comp_map["D-M"] = 0b1'010011;
-        comp_map["M-D"] = 0b1'000111;
-        comp_map["D&M"] = 0b1'000000;
-        comp_map["D|M"] = 0b1'010101;
+        int id = slots[slot];
+        if (id == -1)
+        {
+            slots[slot] = (int)names.size();
+            names.push_back(name);
+            return slots[slot];
+        }
+        if (names[id] == name)
+            return id;
     }
-
 }
 
-void Parser::pass1_A(int index)
+uint16_t Parser::pass1_A(span<const Token> line) const
 {
-    initialise_maps_if_empty();
-    const vector<Token*>& line = tokens[index];
     if (line.size() != 2)
-    {
-        string code;
-        for (auto& x : line)
-            code += x->lexeme + " ";
-        cerr << "Error in line having code: " << code << endl;
-        exit(-1);
-    }
+        throw runtime_error("Error in line having code: " + code_of(line));
 
-    if (line[1]->type == TokenType::TK_NUM)
+    uint16_t word = 0;
+    if (line[1].type == TokenType::TK_NUM)
     {
-        unsigned short num;
-        stringstream sstr{ line[1]->lexeme };
-        sstr >> num;
-        binary[index] = num;
-        binary[index][15] = 0;
-    }
-    else if (line[1]->type == TokenType::TK_SYMBOL)
-        binary[index] = 0x0000;                     // note this - in pass 2, we will update this
-    else if (predefined.find(line[1]->type) != predefined.end())
-        binary[index] = predefined[line[1]->type];
-    else if (line[1]->type == TokenType::TK_REG)
-    {
-        string s = line[1]->lexeme.substr(1);
-        stringstream sstr{ s };
-        int x;
-        sstr >> x;
-        binary[index] = x;
+        from_chars(line[1].lexeme.data(), line[1].lexeme.data() + line[1].lexeme.size(), word);
+        word &= 0x7FFF;
     }
+    else if (line[1].type == TokenType::TK_SYMBOL)
+        word = 0x0000;                              // note this - in pass 2, we will update this
+    else if (auto x = predefined.find(line[1].type); x != predefined.end())
+        word = x->second;
+    else if (line[1].type == TokenType::TK_REG)
+        from_chars(line[1].lexeme.data() + 1, line[1].lexeme.data() + line[1].lexeme.size(), word);
     else
-    {
-        // this should never occur
-        cerr << "Undefined case!" << endl;
-        exit(-1);
-    }
+        throw runtime_error("Undefined case!");     // this should never occur
 
     // make sure the last bit is unset
-    assert(!binary[index].test(15));
+    assert(!(word & 0x8000));
+    return word;
 }
 
-string Parser::get_dest_string(const vector<Token*>& line, int eq_index, const string& err_msg)
+void Parser::syntax_error(span<const Token> line, int index) const
 {
-    if (eq_index == -1)
-        return "000";
+    throw runtime_error("Error in line " + to_string(index + 1) + " having code : " + code_of(line));
+}
 
+// The d1 d2 d3 bits, -1 if the line has no valid dest
+int Parser::get_dest(span<const Token> line, int eq_index) const
+{
+    if (eq_index == -1)
+        return 0b000;
     if (eq_index != 1)
-    {
-        cerr << err_msg << endl;
-        exit(-1);
-    }
+        return -1;
 
-    if (line[0]->type != TokenType::TK_M &&
-        line[0]->type != TokenType::TK_A &&
-        line[0]->type != TokenType::TK_D &&
-        line[0]->type != TokenType::TK_AM &&
-        line[0]->type != TokenType::TK_MD &&
-        line[0]->type != TokenType::TK_AD &&
-        line[0]->type != TokenType::TK_AMD)
+    switch (line[0].type)
     {
-        cerr << err_msg << endl;
-        exit(-1);
+    case TokenType::TK_M: return 0b001;
+    case TokenType::TK_D: return 0b010;
+    case TokenType::TK_MD: return 0b011;
+    case TokenType::TK_A: return 0b100;
+    case TokenType::TK_AM: return 0b101;
+    case TokenType::TK_AD: return 0b110;
+    case TokenType::TK_AMD: return 0b111;
+    default: return -1;
     }
-
-    string dest_string = "000";
-    if (line[0]->lexeme.find('M') != string::npos)
-        dest_string[2] = '1';
-    if (line[0]->lexeme.find('D') != string::npos)
-        dest_string[1] = '1';
-    if (line[0]->lexeme.find('A') != string::npos)
-        dest_string[0] = '1';
-
-    return dest_string;
 }
 
-string Parser::get_comp_string(const vector<Token*>& line, int comp_from, int comp_to, const string& err_msg)
+// The a c1..c6 bits of tokens [comp_from, comp_to], -1 if they are no comp of the ISA
+int Parser::get_comp(span<const Token> line, int comp_from, int comp_to) const
 {
-    string comp_string;
-    for (int i = comp_from; i <= comp_to; ++i)
-        comp_string += line[i]->lexeme;
+    if (comp_to < comp_from || comp_to - comp_from >= 3)
+        return -1;
 
-    if (comp_map.find(comp_string) == comp_map.end())
+    uint16_t key = 0;
+    for (int i = comp_from, shift = 0; i <= comp_to; ++i, shift += 4)
     {
-        cerr << err_msg << endl;
-        exit(-1);
+        uint16_t code = comp_code(line[i]);
+        if (code == 0)
+            return -1;
+        key |= code << shift;
     }
 
-    return comp_map[comp_string].to_string();
+    const COMP_ENTRY& entry = COMP_TABLE[comp_slot(key, COMP_MULTIPLIER)];
+    if (entry.key != key || (entry.hackx && !hackx))
+        return -1;
+    return entry.bits;
 }
 
-string Parser::get_jump_string(const vector<Token*>& line, int semi_index, const string& err_msg)
+// The j1 j2 j3 bits, -1 if the line has no valid jump
+int Parser::get_jump(span<const Token> line, int semi_index) const
 {
     if (semi_index == -1)
-        return "000";
-
+        return 0b000;
     if (semi_index != line.size() - 2)
-    {
-        cerr << err_msg << endl;
-        exit(-1);
-    }
+        return -1;
 
-    if (line.back()->type != TokenType::TK_JGT &&
-        line.back()->type != TokenType::TK_JEQ &&
-        line.back()->type != TokenType::TK_JGE &&
-        line.back()->type != TokenType::TK_JLT &&
-        line.back()->type != TokenType::TK_JNE &&
-        line.back()->type != TokenType::TK_JLE &&
-        line.back()->type != TokenType::TK_JMP)
+    switch (line.back().type)
     {
-        cerr << err_msg << endl;
-        exit(-1);
+    case TokenType::TK_JGT: return 0b001;
+    case TokenType::TK_JEQ: return 0b010;
+    case TokenType::TK_JGE: return 0b011;
+    case TokenType::TK_JLT: return 0b100;
+    case TokenType::TK_JNE: return 0b101;
+    case TokenType::TK_JLE: return 0b110;
+    case TokenType::TK_JMP: return 0b111;
+    default: return -1;
     }
-
-    return jmp_map[line.back()->type].to_string();
 }
 
-void Parser::pass1_C(int index)
+uint16_t Parser::pass1_C(span<const Token> line, int index) const
 {
-    initialise_maps_if_empty();
-    const vector<Token*>& line = tokens[index];
-
     // get separator indices
     int eq_index = -1;
     int semi_index = -1;
     for (int i = 0; i < line.size(); ++i)
-        if (line[i]->type == TokenType::TK_ASSIGN)
+        if (line[i].type == TokenType::TK_ASSIGN)
             eq_index = i;
-        else if (line[i]->type == TokenType::TK_SEMICOLON)
+        else if (line[i].type == TokenType::TK_SEMICOLON)
             semi_index = i;
 
-    // prepare error msg to display
-    string err_msg = "Error in line " + to_string(index + 1) + " having code : ";
-    for (auto& x : line)
-        err_msg += x->lexeme + " ";
-
-    auto dest_string = get_dest_string(line, eq_index, err_msg);
-    auto comp_string = get_comp_string(line, eq_index + 1, semi_index == -1 ? line.size() - 1 : semi_index - 1, err_msg);
-    auto jmp_string = get_jump_string(line, semi_index, err_msg);
+    int dest = get_dest(line, eq_index);
+    int comp = get_comp(line, eq_index + 1, semi_index == -1 ? (int)line.size() - 1 : semi_index - 1);
+    int jump = get_jump(line, semi_index);
+    if (dest < 0 || comp < 0 || jump < 0)
+        syntax_error(line, index);
 
-    binary[index] = bitset<16>("111" + comp_string + dest_string + jmp_string);
+    return 0b111 << 13 | comp << 6 | dest << 3 | jump;
 }
 
 void Parser::pass1_L(int index)
 {
-    // (..) - should be unique
-    const vector<Token*>& line = tokens[index];
-
-    string err_msg = "Error in line " + to_string(index + 1) + " having code : ";
-    for (auto& x : line)
-        err_msg += x->lexeme + " ";
+    check_label(line(index), index);
+    define_label(line(index)[1].symbol, index);
+}
 
+void Parser::check_label(span<const Token> line, int index) const
+{
     if (line.size() != 3 ||
-        line[0]->type != TokenType::TK_OB ||
-        line[1]->type != TokenType::TK_SYMBOL ||
-        line[2]->type != TokenType::TK_CB)
-    {
-        cerr << err_msg << endl;
-        exit(-1);
-    }
+        line[0].type != TokenType::TK_OB ||
+        line[1].type != TokenType::TK_SYMBOL ||
+        line[2].type != TokenType::TK_CB)
+        syntax_error(line, index);
+}
 
+void Parser::define_label(int symbol, int index)
+{
+    // (..) - should be unique
     // it is guaranteed that the symbol is not one of predefined language symbols - check fot TK_SYMBOL
 
-    if (jmp_locations.find(line[1]->lexeme) != jmp_locations.end())
+    if (jmp_locations[symbol] != -1)
+        throw runtime_error("Symbol '" + string(symbols.names[symbol]) + "' is defined earlier!");
+
+    jmp_locations[symbol] = index;
+}
+
+uint16_t Parser::pass1_MOVE(span<const Token> line, int index) const
+{
+    // MOVE n - HackX block move of n words from RAM[D] to RAM[A], 1 <= n <= 64
+    int count = 0;
+    if (hackx && line.size() == 2 && line[1].type == TokenType::TK_NUM)
+        from_chars(line[1].lexeme.data(), line[1].lexeme.data() + line[1].lexeme.size(), count);
+    if (count < 1 || count > 64)
+        syntax_error(line, index);
+
+    return 0b1110'0010'0000'0000 | (count - 1);
+}
+
+int Parser::get_bank(span<const Token> line, int index) const
+{
+    // BANK n - place the following lines in ROM bank n, only with --banked
+    int bank = -1;
+    if (banked && line.size() == 2 && line[1].type == TokenType::TK_NUM)
+        from_chars(line[1].lexeme.data(), line[1].lexeme.data() + line[1].lexeme.size(), bank);
+    if (bank < 0 || bank >= MAX_BANKS)
+        syntax_error(line, index);
+    return bank;
+}
+
+void Parser::pass1_BANK(int index)
+{
+    bank_directives[index] = get_bank(line(index), index);
+}
+
+void Parser::layout_banks()
+{
+    // every line keeps its word, appended to the bank selected by the last BANK directive
+    vector<int> cursor(MAX_BANKS);
+    for (int k = 0; k < MAX_BANKS; ++k)
+        cursor[k] = k * BANK_SIZE;
+
+    bank_of.assign(lines(), 0);
+    address_of.assign(lines(), -1);
+    int bank = 0;
+    int last_bank = 1;
+    for (int i = 0; i < lines(); ++i)
     {
-        cerr << "Symbol '" << line[1]->lexeme << "' is defined earlier!" << endl;
-        exit(-1);
+        if (bank_directives.find(i) != bank_directives.end())
+        {
+            bank = bank_directives[i];
+            last_bank = max(last_bank, bank);
+            continue;
+        }
+
+        if (cursor[bank] == (bank + 1) * BANK_SIZE)
+            throw runtime_error("Error in line " + to_string(i + 1) + ": ROM bank " + to_string(bank) + " is full");
+        bank_of[i] = bank;
+        address_of[i] = cursor[bank]++;
     }
 
-    jmp_locations[line[1]->lexeme] = index;
+    trampoline_cursor = cursor[0];
+    trampolines.assign(symbols.names.size(), -1);
+    image.assign((last_bank + 1) * BANK_SIZE, bitset<16>(65535));
+}
+
+bool Parser::is_jump_target(int index) const
+{
+    // @LABEL directly followed by a jump without dest, anything else may keep the address
+    if (index + 1 >= lines() || line(index + 1).empty())
+        return false;
+
+    auto next = line(index + 1);
+    if (next[0].type == TokenType::TK_AT || next[0].type == TokenType::TK_OB ||
+        next[0].type == TokenType::TK_MOVE || next[0].type == TokenType::TK_BANK)
+        return false;
+
+    bool has_jump = false;
+    for (auto& x : next)
+        if (x.type == TokenType::TK_ASSIGN)
+            return false;
+        else if (x.type == TokenType::TK_SEMICOLON)
+            has_jump = true;
+    return has_jump;
+}
+
+int Parser::far_jump(int symbol, int to_bank)
+{
+    if (trampolines[symbol] != -1)
+        return trampolines[symbol];
+
+    if (trampoline_cursor + 4 > BANK_SIZE)
+        throw runtime_error("ROM bank 0 is full, no room for the far jump to '" + string(symbols.names[symbol]) + "'");
+
+    // @BANK_SELECT+k, M=0 (selects bank k, keeps D), @label, 0;JMP
+    int address = trampoline_cursor;
+    image[address] = BANK_SELECT + to_bank;
+    image[address + 1] = bitset<16>("1110101010001000");
+    image[address + 2] = BANK_SIZE + address_of[jmp_locations[symbol]] % BANK_SIZE;
+    image[address + 3] = bitset<16>("1110101010000111");
+    trampoline_cursor += 4;
+    trampolines[symbol] = address;
+    return address;
+}
+
+int Parser::label_address(int symbol, int index)
+{
+    int target = jmp_locations[symbol];
+    if (!banked)
+        return target;
+
+    // bank 0 is always mapped, a switched bank only while it is selected: a jump within the
+    // bank goes straight there, everything else (other banks, addresses kept as data such as
+    // return addresses) goes through a far-jump stub in bank 0
+    int bank = bank_of[target];
+    if (bank == 0)
+        return address_of[target];
+    if (bank == bank_of[index] && is_jump_target(index))
+        return BANK_SIZE + address_of[target] % BANK_SIZE;
+    return far_jump(symbol, bank);
 }
 
 void Parser::pass2_A(int index)
 {
-    const vector<Token*>& line = tokens[index];
-    if (line[1]->type != TokenType::TK_SYMBOL)
+    auto line = this->line(index);
+    if (line[1].type != TokenType::TK_SYMBOL)
         return;
 
-    bool is_jmp_location = (jmp_locations.find(line[1]->lexeme) != jmp_locations.end());
-    if (is_jmp_location)
+    int symbol = line[1].symbol;
+    if (jmp_locations[symbol] != -1)
     {
-        binary[index] = jmp_locations[line[1]->lexeme];
+        binary[index] = label_address(symbol, index);
         assert(!binary[index].test(15));
         return;
     }
 
-    if (variable_locations.find(line[1]->lexeme) == variable_locations.end())
-        variable_locations[line[1]->lexeme] = RAM_INDEX++;
+    if (variable_locations[symbol] == -1)
+        variable_locations[symbol] = RAM_INDEX++;
 
-    binary[index] = variable_locations[line[1]->lexeme];
+    binary[index] = variable_locations[symbol];
     assert(!binary[index].test(15));
 }
 
 void Parser::debug_output(int index)
 {
-    cerr << "Line: " << tokens[index][0]->line_number << ":" << endl;
-    for (auto& x : tokens[index])
-        cerr << "\t" << *x << endl;
+    cerr << "Line: " << line(index)[0].line_number << ":" << endl;
+    for (auto& x : line(index))
+        cerr << "\t" << x << endl;
+}
+
+static bool is_error(const Token& token)
+{
+    return token.type == TokenType::TK_ERROR_SYMBOL || token.type == TokenType::TK_ERROR_PATTERN || token.type == TokenType::TK_ERROR_LENGTH;
+}
+
+static string describe(const Token& token)
+{
+    ostringstream out;
+    out << token;
+    return out.str();
 }
 
-Parser::Parser(Buffer& buffer)
+Parser::Parser(Buffer& buffer, bool hackx, bool banked, int threads, const string& cache)
+    : hackx{ hackx }, banked{ banked }, threads{ threads }
 {
-    auto token = getNextToken(buffer);
+    initialise_maps_if_empty();
 
-    if (token->type == TokenType::TK_ERROR_SYMBOL || token->type == TokenType::TK_ERROR_PATTERN || token->type == TokenType::TK_ERROR_LENGTH)
+    // symbol resolution in banked mode depends on the order of references, it stays sequential
+    // and cannot reuse cached regions
+    if (banked && !cache.empty())
+        throw runtime_error("--cache cannot be used with --banked");
+    if (!banked && (!cache.empty() || (threads > 1 && buffer.size() >= 2 * MIN_CHUNK_BYTES)))
     {
-        cerr << *token << endl;
-        exit(-1);
+        if (!cache.empty())
+        {
+            cache_path = cache;
+            this->cache.emplace(cache, hackx ? 1u : 0u);
+        }
+        lex_chunks(buffer);
+        return;
+    }
+
+    // one token per 4 source bytes covers typical assembly, the arena grows geometrically past that
+    tokens.reserve(buffer.size() / 4 + 1);
+
+    Token token = getNextToken(buffer);
+    for (; token.type != TokenType::TK_EOF; token = getNextToken(buffer))
+    {
+        if (is_error(token))
+            throw runtime_error(describe(token));
+        if (token.type == TokenType::TK_SYMBOL)
+            token.symbol = symbols.intern(token.lexeme);
+        tokens.push_back(token);
     }
+    index_lines(token.line_number);
+}
 
-    int delta = token->line_number;
-    while (delta--)
-        tokens.push_back({});
+void Parser::index_lines(int eof_line)
+{
+    // line i is source line i + 1; a trailing line without tokens is dropped, like the EOF line
+    int last_line = tokens.empty() ? 0 : tokens.back().line_number;
+    int line_count = last_line == eof_line ? last_line : eof_line - 1;
 
-    tokens.back().push_back(token);
+    line_start.assign(line_count + 1, 0);
+    for (auto& x : tokens)
+        line_start[x.line_number]++;
+    for (int i = 0; i < line_count; ++i)
+        line_start[i + 1] += line_start[i];
 
-    while (token->type != TokenType::TK_EOF)
+    jmp_locations.assign(symbols.names.size(), -1);
+    variable_locations.assign(symbols.names.size(), -1);
+    binary = vector<bitset<16>>();
+}
+
+void Parser::for_each_chunk(const function<void(CHUNK&)>& f)
+{
+    // workers take chunks in order until none are left
+    atomic<size_t> next{ 0 };
+    auto work = [&] {
+        for (size_t k; (k = next++) < chunks.size();)
+            f(chunks[k]);
+    };
+
+    vector<thread> workers;
+    for (size_t t = 1; t < min<size_t>(threads, chunks.size()); ++t)
+        workers.emplace_back(work);
+    work();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void Parser::cut_evenly(string_view text)
+{
+    // one chunk per thread
+    int count = (int)min<size_t>(threads, text.size() / MIN_CHUNK_BYTES);
+    size_t begin = 0;
+    for (int k = 1; k <= count; ++k)
     {
-        token = getNextToken(buffer);
+        size_t cut = k == count ? string_view::npos : text.find('\n', max(begin, text.size() * k / count));
+        size_t end = cut == string_view::npos ? text.size() : cut + 1;
+        chunks.push_back({ text.substr(begin, end - begin) });
+        begin = end;
+    }
+}
 
-        if (token->type == TokenType::TK_ERROR_SYMBOL || token->type == TokenType::TK_ERROR_PATTERN || token->type == TokenType::TK_ERROR_LENGTH)
+void Parser::cut_regions(string_view text)
+{
+    // a region ends after a line whose hash has REGION_CUT_MASK clear, so the cuts depend on the
+    // lines themselves and not on their offsets; the bounds keep regions from being too small
+    // to pay off or too large to reuse
+    size_t begin = 0;
+    int lines = 0;
+    uint32_t hash = 0x811C9DC5u;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        if (text[i] != '\n')
         {
-            cerr << *token << endl;
-            exit(-1);
+            hash = (hash ^ (unsigned char)text[i]) * 0x01000193u;
+            continue;
         }
-        int delta = token->line_number - tokens.back().back()->line_number;
-        while (delta--)
-            tokens.push_back({});
-        tokens.back().push_back(token);
+
+        ++lines;
+        if ((lines >= MIN_REGION_LINES && (hash & REGION_CUT_MASK) == 0) || lines >= MAX_REGION_LINES)
+        {
+            chunks.push_back({ text.substr(begin, i + 1 - begin) });
+            begin = i + 1;
+            lines = 0;
+        }
+        hash = 0x811C9DC5u;
     }
-    tokens.back().pop_back();
-    if (tokens.back().size() == 0)
-        tokens.pop_back();
+    if (begin < text.size() || chunks.empty())
+        chunks.push_back({ text.substr(begin) });
+}
 
-    binary = vector<bitset<16>>();
+void Parser::lex_chunks(Buffer& buffer)
+{
+    // cut at line boundaries, tokens never span lines
+    chunked = true;
+    if (cache)
+        cut_regions(buffer.text());
+    else
+        cut_evenly(buffer.text());
+
+    for_each_chunk([&](CHUNK& chunk) {
+        if (cache)
+            if (const REGION* region = cache->find(chunk.text))
+            {
+                chunk.region = *region;
+                chunk.cached = true;
+                return;
+            }
+
+        // line numbers count from 0 within the chunk, it is encoded once its first line is known
+        Buffer window(chunk.text, 0);
+        Token token = getNextToken(window);
+        for (; token.type != TokenType::TK_EOF; token = getNextToken(window))
+        {
+            if (is_error(token))
+            {
+                chunk.error_token = token;
+                return;
+            }
+            if (token.type == TokenType::TK_SYMBOL)
+                token.symbol = chunk.symbols.intern(token.lexeme);
+            chunk.tokens.push_back(token);
+        }
+
+        // only the last chunk can end in a line without a newline, it counts if it has tokens
+        REGION& region = chunk.region;
+        region.newlines = window.line_number;
+        region.lines = region.newlines + (!chunk.tokens.empty() && chunk.tokens.back().line_number == region.newlines);
+        chunk.line_start.assign(region.lines + 1, 0);
+        for (auto& x : chunk.tokens)
+            chunk.line_start[x.line_number + 1]++;
+        for (int j = 0; j < region.lines; ++j)
+            chunk.line_start[j + 1] += chunk.line_start[j];
+        region.names = chunk.symbols.names;
+    });
+
+    // lexing errors come before any other, the first one in the file is reported
+    int line_number = 0;
+    for (auto& chunk : chunks)
+    {
+        if (chunk.error_token)
+        {
+            chunk.error_token->line_number += line_number + 1;
+            throw runtime_error(describe(*chunk.error_token));
+        }
+        chunk.first_line = line_number;
+        line_number += chunk.region.newlines;
+    }
+}
+
+void Parser::encode_chunk(CHUNK& chunk) const
+{
+    REGION& region = chunk.region;
+    region.words.assign(region.lines, 0xFFFF);
+    for (int j = 0; j < region.lines; ++j)
+    {
+        span<const Token> line{ chunk.tokens.data() + chunk.line_start[j], chunk.tokens.data() + chunk.line_start[j + 1] };
+        if (line.empty())
+            continue;
+
+        int index = chunk.first_line + j;
+        try
+        {
+            if (line[0].type == TokenType::TK_AT)
+            {
+                region.words[j] = pass1_A(line);
+                if (line[1].type == TokenType::TK_SYMBOL)
+                    region.references.push_back({ j, line[1].symbol });
+            }
+            else if (line[0].type == TokenType::TK_OB)
+            {
+                check_label(line, index);
+                region.labels.push_back({ j, line[1].symbol });
+            }
+            else if (line[0].type == TokenType::TK_MOVE)
+                region.words[j] = pass1_MOVE(line, index);
+            else if (line[0].type == TokenType::TK_BANK)
+                get_bank(line, index);                  // not banked, always an error
+            else
+                region.words[j] = pass1_C(line, index);
+        }
+        catch (const runtime_error& e)
+        {
+            chunk.error_line = index;
+            chunk.error = e.what();
+            return;
+        }
+    }
+    chunk.tokens = vector<Token>();
+    chunk.line_start = vector<int>();
+}
+
+const vector<bitset<16>>& Parser::convert_chunks()
+{
+    for_each_chunk([&](CHUNK& chunk) {
+        if (!chunk.cached)
+            encode_chunk(chunk);
+    });
+
+    for (auto& chunk : chunks)
+        for (auto name : chunk.region.names)
+            chunk.global.push_back(symbols.intern(name));
+    jmp_locations.assign(symbols.names.size(), -1);
+    variable_locations.assign(symbols.names.size(), -1);
+
+    // the first error in line order wins, as in a sequential run: a chunk stops at its first
+    // failing line, a label defined twice fails at its second definition
+    int error_line = INT_MAX;
+    string error;
+    for (auto& chunk : chunks)
+        if (chunk.error_line < error_line)
+        {
+            error_line = chunk.error_line;
+            error = chunk.error;
+            break;
+        }
+    for (auto& chunk : chunks)
+        for (auto [j, symbol] : chunk.region.labels)
+        {
+            int i = chunk.first_line + j;
+            if (i > error_line)
+                break;
+            try
+            {
+                define_label(chunk.global[symbol], i);
+            }
+            catch (const runtime_error& e)
+            {
+                error_line = i;
+                error = e.what();
+            }
+        }
+    if (error_line != INT_MAX)
+        throw runtime_error(error);
+
+    // variables take RAM addresses in order of first reference
+    for (auto& chunk : chunks)
+        for (auto [j, symbol] : chunk.region.references)
+        {
+            int id = chunk.global[symbol];
+            if (jmp_locations[id] == -1 && variable_locations[id] == -1)
+                variable_locations[id] = RAM_INDEX++;
+        }
+
+    binary.resize(chunks.back().first_line + chunks.back().region.lines);
+    for_each_chunk([&](CHUNK& chunk) {
+        const REGION& region = chunk.region;
+        for (int j = 0; j < region.lines; ++j)
+            binary[chunk.first_line + j] = region.words[j];
+        for (auto [j, symbol] : region.references)
+        {
+            int id = chunk.global[symbol];
+            binary[chunk.first_line + j] = jmp_locations[id] != -1 ? jmp_locations[id] : variable_locations[id];
+            assert(!binary[chunk.first_line + j].test(15));
+        }
+    });
+
+    if (cache)
+    {
+        vector<pair<string_view, const REGION*>> regions;
+        for (auto& chunk : chunks)
+            regions.push_back({ chunk.text, &chunk.region });
+        REGION_CACHE::save(cache_path, hackx ? 1u : 0u, regions);
+    }
+    return binary;
 }
 
 const vector<bitset<16>>& Parser::convert_to_binary()
 {
     if (binary.size() > 0)
         return binary;
+    if (chunked)
+        return convert_chunks();
 
-    for (int i = 0; i < tokens.size(); ++i)
+    binary.assign(lines(), bitset<16>(65535));
+    for (int i = 0; i < lines(); ++i)
     {
-        binary.push_back(bitset<16>(65535));
-        if (tokens[i].size() == 0)
+        auto line = this->line(i);
+        if (line.empty())
             continue;
 
-        if (tokens[i][0]->type == TokenType::TK_AT)
-            pass1_A(i);
-        else if (tokens[i][0]->type == TokenType::TK_OB)
+        if (line[0].type == TokenType::TK_AT)
+            binary[i] = pass1_A(line);
+        else if (line[0].type == TokenType::TK_OB)
             pass1_L(i);
+        else if (line[0].type == TokenType::TK_MOVE)
+            binary[i] = pass1_MOVE(line, i);
+        else if (line[0].type == TokenType::TK_BANK)
+            pass1_BANK(i);
         else
-            pass1_C(i);
+            binary[i] = pass1_C(line, i);
     }
 
-    for (int i = 0; i < tokens.size(); ++i)
-    {
-        if (tokens[i].size() == 0)
-            continue;
+    if (banked)
+        layout_banks();
 
-        if (tokens[i][0]->type == TokenType::TK_AT)
+    for (int i = 0; i < lines(); ++i)
+    {
+        auto line = this->line(i);
+        if (!line.empty() && line[0].type == TokenType::TK_AT)
             pass2_A(i);
     }
 
-    return binary;
+    if (!banked)
+        return binary;
+
+    for (int i = 0; i < lines(); ++i)
+        if (address_of[i] != -1)
+            image[address_of[i]] = binary[i];
+
+    // gaps between banks stay NOPs, only the tail is dropped
+    while (!image.empty() && image.back().all())
+        image.pop_back();
+
+    return image;
 }
 
-void Parser::print_symbol_table() const
+vector<pair<int, string_view>> Parser::labels() const
 {
-    cerr << endl << "JUMP Locations:" << endl;
-    vector<pair<int, string>> locs;
-    for (auto& x : jmp_locations)
-        locs.push_back({ x.second, x.first });
+    vector<pair<int, string_view>> locs;
+    for (int id = 0; id < symbols.names.size(); ++id)
+        if (jmp_locations[id] != -1)
+            locs.push_back({ banked ? address_of[jmp_locations[id]] : jmp_locations[id], symbols.names[id] });
     sort(locs.begin(), locs.end());
+    return locs;
+}
 
-    for (auto& x : locs)
-        cerr << "ROM " << setw(4) << x.first << " is the location for :" << x.second << endl;
+vector<pair<string_view, int>> Parser::variables() const
+{
+    vector<pair<string_view, int>> vars;
+    for (int id = 0; id < symbols.names.size(); ++id)
+        if (variable_locations[id] != -1)
+            vars.push_back({ symbols.names[id], variable_locations[id] });
+    sort(vars.begin(), vars.end());
+    return vars;
+}
 
-    cerr << endl << "Variable Locations: " << endl;
-    for (auto& x : variable_locations)
-        cerr << "RAM " << bitset<16>(x.second) << " stores the variable: " << x.first << endl;
+vector<int> Parser::source_lines() const
+{
+    if (!banked)
+    {
+        vector<int> lines(binary.size());
+        for (int i = 0; i < lines.size(); ++i)
+            lines[i] = i + 1;
+        return lines;
+    }
+
+    vector<int> lines(image.size(), 0);
+    for (int i = 0; i < address_of.size(); ++i)
+        if (address_of[i] != -1 && address_of[i] < lines.size())
+            lines[address_of[i]] = i + 1;
+    return lines;
 }
 
-Parser::~Parser()
+void Parser::print_symbol_table() const
 {
-    for (auto& x : tokens)
-        for (auto& y : x)
-            delete y;
+    // stderr is unbuffered, the report goes out in one write
+    ostringstream out;
+    out << endl << "JUMP Locations:" << endl;
+    for (auto& x : labels())
+        out << "ROM " << setw(4) << x.first << " is the location for :" << x.second << endl;
+
+    out << endl << "Variable Locations: " << endl;
+    for (auto& x : variables())
+        out << "RAM " << bitset<16>(x.second) << " stores the variable: " << x.first << endl;
+    cerr << out.str();
 }
@@ -1,35 +1,121 @@
 #pragma once
 #include "Lexer.h"
+#include "Cache.h"
 #include <bitset>
+#include <climits>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string_view>
+
+// Interned names: id -> name, and an open-addressed table of ids hashed by name
+struct SYMBOL_TABLE
+{
+    std::vector<std::string_view> names;
+    std::vector<int> slots;
+
+    int intern(std::string_view name);
+};
 
 class Parser
 {
-    std::vector<std::vector<Token*>> tokens;
+    // Token arena in source order: line i owns tokens [line_start[i], line_start[i + 1])
+    std::vector<Token> tokens;
+    std::vector<int> line_start;
     std::vector<std::bitset<16>> binary;
+    std::vector<std::bitset<16>> image;     // physical ROM image in banked mode
 
-    std::map<std::string, int> jmp_locations;
-    std::map<std::string, int> variable_locations;
+    SYMBOL_TABLE symbols;                   // TK_SYMBOL lexemes, Token::symbol is the id
+
+    std::vector<int> jmp_locations;         // symbol id -> line index of its label, -1 if none
+    std::vector<int> variable_locations;    // symbol id -> RAM address, -1 if none
 
     static std::map<TokenType, unsigned short> predefined;
-    static std::map<std::string, std::bitset<7>> comp_map;
-    static std::map<TokenType, std::bitset<3>> jmp_map;
 
     int RAM_INDEX = 16;
+    bool hackx = false;
+
+    // Banked mode: ROM bank 0 is fixed at 0x0000-0x3FFF, the bank selected by writing any
+    // word of the bank-select register BANK_SELECT + k is mapped at 0x4000-0x7FFF
+    static const int BANK_SIZE = 0x4000;
+    static const int BANK_SELECT = 0x7F00;
+    static const int MAX_BANKS = 256;
+
+    bool banked = false;
+    std::map<int, int> bank_directives;     // line index -> bank selected by its BANK directive
+    std::vector<int> bank_of;               // line index -> bank
+    std::vector<int> address_of;            // line index -> physical ROM address, -1 if none
+    std::vector<int> trampolines;           // symbol id -> physical address of its far-jump stub, -1 if none
+    int trampoline_cursor = 0;
+
+    // Chunked assembly: the input is cut at line boundaries and every chunk is lexed and encoded
+    // on its own, on parallel workers, then merged in order so the output matches a sequential
+    // run. With a cache the cuts follow the content, so an edit only changes the chunks around
+    // it, and a chunk found in the cache is restored instead of lexed and encoded again.
+    static const int MIN_CHUNK_BYTES = 1 << 16;
+    static const int MIN_REGION_LINES = 64;
+    static const int MAX_REGION_LINES = 4096;
+    static const uint32_t REGION_CUT_MASK = 255;   // a line whose hash has these bits clear ends a region
+
+    struct CHUNK
+    {
+        std::string_view text;
+        REGION region;                      // lines and symbol ids counted within the chunk
+        bool cached = false;
+        std::vector<Token> tokens;          // lines counted from 0, until encoded
+        std::vector<int> line_start;
+        SYMBOL_TABLE symbols;
+        std::optional<Token> error_token;
+        int first_line = 0;                 // line index of the chunk's first line
+        std::vector<int> global;            // chunk symbol id -> symbol id
+        int error_line = INT_MAX;           // first line that failed to encode
+        std::string error;
+    };
+    std::vector<CHUNK> chunks;
+    bool chunked = false;
+    int threads = 1;
+    std::string cache_path;
+    std::optional<REGION_CACHE> cache;
+
 
+    int lines() const { return (int)line_start.size() - 1; }
+    std::span<const Token> line(int index) const;
 
     void initialise_maps_if_empty();
-    void pass1_A(int index);
-    std::string get_dest_string(const std::vector<Token*>& line, int eq_index, const std::string& err_msg);
-    std::string get_comp_string(const std::vector<Token*>& line, int comp_from, int comp_to, const std::string& err_msg);
-    std::string get_jump_string(const std::vector<Token*>& line, int semi_index, const std::string& err_msg);
-    void pass1_C(int index);
+    std::string code_of(std::span<const Token> line) const;
+    uint16_t pass1_A(std::span<const Token> line) const;
+    [[noreturn]] void syntax_error(std::span<const Token> line, int index) const;
+    int get_dest(std::span<const Token> line, int eq_index) const;
+    int get_comp(std::span<const Token> line, int comp_from, int comp_to) const;
+    int get_jump(std::span<const Token> line, int semi_index) const;
+    uint16_t pass1_C(std::span<const Token> line, int index) const;
     void pass1_L(int index);
+    void check_label(std::span<const Token> line, int index) const;
+    void define_label(int symbol, int index);
+    uint16_t pass1_MOVE(std::span<const Token> line, int index) const;
+    int get_bank(std::span<const Token> line, int index) const;
+    void pass1_BANK(int index);
+    void layout_banks();
+    bool is_jump_target(int index) const;
+    int far_jump(int symbol, int to_bank);
+    int label_address(int symbol, int index);
     void pass2_A(int index);
     void debug_output(int index);
+    void index_lines(int eof_line);
+    void for_each_chunk(const std::function<void(CHUNK&)>& f);
+    void cut_evenly(std::string_view text);
+    void cut_regions(std::string_view text);
+    void lex_chunks(Buffer& buffer);
+    void encode_chunk(CHUNK& chunk) const;
+    const std::vector<std::bitset<16>>& convert_chunks();
 
 public:
-    Parser(Buffer& buffer);
+    // Errors in the input are thrown as runtime_error with the message to report. A cache path
+    // enables incremental assembly through the region cache kept there.
+    Parser(Buffer& buffer, bool hackx = false, bool banked = false, int threads = 1, const std::string& cache = "");
     const std::vector<std::bitset<16>>& convert_to_binary();
+    std::vector<std::pair<int, std::string_view>> labels() const;          // (ROM address, name), by address
+    std::vector<std::pair<std::string_view, int>> variables() const;       // (name, RAM address), by name
+    std::vector<int> source_lines() const;      // source line of each converted word, 0 if none
     void print_symbol_table() const;
-    ~Parser();
 };
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+#include <array>
+#include <format>
+#include <stdexcept>
+#include <vector>
+#include "Devices.h"
+#include "Motherboard.h"
+
+using namespace std;
+
+// ROM banking for programs larger than the 32K instruction address space. The ROM image is
+// split into 16K-word banks: bank 0 is always mapped at 0x0000-0x3FFF, and the bank selected
+// through the bank-select register is mapped at 0x4000-0x7FFF (bank 1 after reset, so an
+// image of up to 32K words runs unchanged). The register is BANK_COUNT words of the device
+// window starting at BANK_SELECT_BASE; writing any value to word k selects bank k, so the
+// assembler's far-jump stubs can switch with M=0 and keep D.
+const uint16_t BANK_SIZE = 0x4000;
+const uint16_t BANK_SELECT_BASE = 0x7F00;
+const uint16_t MAX_BANKS = 0x100;
+
+struct BANKED_INSTRUCTION_MEMORY
+{
+    vector<uint16_t> image = vector<uint16_t>(2 * BANK_SIZE);
+    // Fixed and switched half of the address space: a fetch is one extra load, no branch
+    array<const uint16_t*, 2> halves{ image.data(), image.data() + BANK_SIZE };
+    uint16_t selected = 1;
+
+    BANKED_INSTRUCTION_MEMORY() = default;
+
+    BANKED_INSTRUCTION_MEMORY(const BANKED_INSTRUCTION_MEMORY& other) : image(other.image), selected(other.selected)
+    {
+        select(selected);
+    }
+
+    BANKED_INSTRUCTION_MEMORY& operator=(const BANKED_INSTRUCTION_MEMORY& other)
+    {
+        image = other.image;
+        select(other.selected);
+        return *this;
+    }
+
+    uint16_t bank_count() const { return (uint16_t)(image.size() / BANK_SIZE); }
+
+    // Stores a word of the physical image, whose bank k holds words k * BANK_SIZE onwards
+    void load(size_t address, uint16_t value)
+    {
+        if (address >= (size_t)MAX_BANKS * BANK_SIZE)
+            throw runtime_error(format("ROM image exceeds {} banks at word {}", MAX_BANKS, address));
+
+        if (address >= image.size())
+            image.resize((address / BANK_SIZE + 1) * BANK_SIZE);
+        image[address] = value;
+        select(selected);
+    }
+
+    void select(uint16_t bank)
+    {
+        if (bank == 0 || bank >= bank_count())
+            throw runtime_error(format("Invalid ROM bank {}, the image has banks 1-{}", bank, bank_count() - 1));
+
+        selected = bank;
+        halves = { image.data(), image.data() + (size_t)bank * BANK_SIZE };
+    }
+
+    const uint16_t& operator[](uint16_t address) const
+    {
+        if (address >= INSTRUCTION_COUNT)
+            INSTRUCTION_MEMORY::invalid_address(address);
+
+        return halves[address / BANK_SIZE][address % BANK_SIZE];
+    }
+};
+
+using BANKED_MOTHERBOARD = BASIC_MOTHERBOARD<DATA_MEMORY, BANKED_INSTRUCTION_MEMORY>;
+
+// The bank-select register. Each switch adds switch_cost cycles to the run, modelling the
+// latency of remapping the upper half of the ROM. Reading any word returns the selected bank.
+struct BANK_SELECT_DEVICE : DEVICE
+{
+    BANKED_INSTRUCTION_MEMORY& im;
+    uint64_t& cycles;
+    uint64_t switch_cost;
+    uint64_t switches = 0;
+
+    BANK_SELECT_DEVICE(BANKED_INSTRUCTION_MEMORY& im, uint64_t& cycles, uint64_t switch_cost)
+        : im(im), cycles(cycles), switch_cost(switch_cost) {}
+
+    const char* name() const override { return "bank select"; }
+    uint16_t size() const override { return MAX_BANKS; }
+
+    int16_t read(uint16_t) override { return im.selected; }
+
+    void write(uint16_t offset, int16_t) override
+    {
+        im.select(offset);
+        ++switches;
+        cycles += switch_cost;
+    }
+};
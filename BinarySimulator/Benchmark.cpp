@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "Engines.h"
+
+using namespace std;
+
+struct Workload
+{
+    string name;
+    vector<uint16_t> rom;
+};
+
+struct Result
+{
+    uint64_t instructions{};
+    double seconds{};
+    long peak_rss_kb{};
+};
+
+static Workload load_workload(const string& path)
+{
+    Workload w;
+    w.name = path.substr(path.find_last_of("/\\") + 1);
+    w.name = w.name.substr(0, w.name.find_last_of('.'));
+
+    load_binary_file(path, [&](size_t, uint16_t val) {
+        w.rom.push_back(val);
+    }, rom_image_flags(ISA::HACK));
+
+    if (w.rom.size() > INSTRUCTION_COUNT)
+        throw runtime_error(format("ROM does not fit in instruction memory: {}", path));
+
+    return w;
+}
+
+// Runs f in a forked child and passes its result back through a pipe. The child's own
+// rusage from wait4 gives the peak RSS of this measurement alone; the process-wide peak
+// would repeat the largest one so far on every later row.
+template <class T, class F>
+static T in_child(F f, const string& what)
+{
+    static_assert(is_trivially_copyable_v<T>);
+
+    int fds[2];
+    if (pipe(fds) != 0)
+        throw runtime_error("pipe failed");
+    cout.flush();
+    cerr.flush();
+
+    pid_t pid = fork();
+    if (pid < 0)
+        throw runtime_error("fork failed");
+    if (pid == 0)
+    {
+        close(fds[0]);
+        int status = 0;
+        try
+        {
+            T result = f();
+            status = write(fds[1], &result, sizeof(result)) == sizeof(result) ? 0 : 1;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Caught exception: '" << e.what() << "'\n";
+            status = 1;
+        }
+        _exit(status);
+    }
+
+    close(fds[1]);
+    T result{};
+    bool got = read(fds[0], &result, sizeof(result)) == sizeof(result);
+    close(fds[0]);
+
+    int status = 0;
+    rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    if (!got || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        throw runtime_error(format("{} failed", what));
+
+    result.peak_rss_kb = usage.ru_maxrss;
+    return result;
+}
+
+static Result measure(const Workload& w, const ENGINE& engine, int repeat, uint64_t max_cycles)
+{
+    Result best{};
+    best.seconds = -1;
+
+    for (int i = 0; i < repeat; ++i)
+    {
+        auto mbd = make_unique<Motherboard>();
+        copy(w.rom.begin(), w.rom.end(), mbd->im.rom.begin());
+
+        auto run = engine.load(*mbd);
+        auto start = chrono::steady_clock::now();
+        uint64_t instructions = run(*mbd, max_cycles);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+        if (mbd->regs.PC != TERMINATION_PC_ADDRESS)
+            throw runtime_error(format("Workload '{}' did not finish within {} cycles on engine '{}'",
+                                       w.name, max_cycles, engine.name));
+
+        if (best.seconds < 0 || elapsed.count() < best.seconds)
+        {
+            best.instructions = instructions;
+            best.seconds = elapsed.count();
+        }
+    }
+
+    return best;
+}
+
+struct InstancesResult
+{
+    size_t bytes{};
+    double seconds{};
+    long peak_rss_kb{};
+};
+
+// Runs the workload on instance_count paged motherboards sharing one ROM, all kept alive,
+// and returns the bytes they hold.
+static InstancesResult measure_instances(const Workload& w, size_t instance_count, uint64_t max_cycles)
+{
+    PAGED_INSTRUCTION_MEMORY rom{};
+    for (size_t i = 0; i < w.rom.size(); ++i)
+        rom[(uint16_t)i] = w.rom[i];
+
+    vector<unique_ptr<PAGED_MOTHERBOARD>> instances;
+    instances.reserve(instance_count);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < instance_count; ++i)
+    {
+        auto& mbd = instances.emplace_back(make_unique<PAGED_MOTHERBOARD>());
+        mbd->im = rom;
+        run_reference(*mbd, max_cycles);
+        if (mbd->regs.PC != TERMINATION_PC_ADDRESS)
+            throw runtime_error(format("Workload '{}' did not finish within {} cycles", w.name, max_cycles));
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    size_t bytes = rom.memory_bytes();
+    for (const auto& mbd : instances)
+        bytes += sizeof(PAGED_MOTHERBOARD) + mbd->dm.memory_bytes() - sizeof(PAGED_DATA_MEMORY) +
+                 mbd->im.memory_bytes() - sizeof(PAGED_INSTRUCTION_MEMORY);
+
+    return { bytes, elapsed.count() };
+}
+
+int main(int argc, char** argv)
+{
+    int repeat = 5;
+    uint64_t max_cycles = 1'000'000'000;
+    size_t instance_count = 0;
+    vector<string> paths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--repeat" && i + 1 < argc)
+            repeat = stoi(argv[++i]);
+        else if (arg == "--max-cycles" && i + 1 < argc)
+            max_cycles = stoull(argv[++i]);
+        else if (arg == "--instances" && i + 1 < argc)
+            instance_count = stoull(argv[++i]);
+        else
+            paths.push_back(arg);
+    }
+
+    if (paths.empty() || repeat < 1)
+    {
+        cerr << "format: ./benchmark.out [--repeat N] [--max-cycles N] [--instances N] rom_file..." << endl;
+        std::exit(-1);
+    }
+
+    try
+    {
+        if (instance_count > 0)
+        {
+            for (auto& path : paths)
+            {
+                auto w = load_workload(path);
+                auto r = in_child<InstancesResult>([&] { return measure_instances(w, instance_count, max_cycles); },
+                                                   format("Workload '{}'", w.name));
+                cerr << format("{:<12}{:>8} paged instances {:>10.1f} KB each ({:.1f} KB flat) {:>10.3f} s, peak RSS {} KB\n",
+                               w.name, instance_count, r.bytes / 1024.0 / instance_count, sizeof(Motherboard) / 1024.0,
+                               r.seconds, r.peak_rss_kb);
+            }
+            return 0;
+        }
+
+        // JSON report on stdout, one entry per (workload, engine) pair.
+        cout << "{\n  \"repeat\": " << repeat << ",\n  \"results\": [";
+        bool first = true;
+        for (auto& path : paths)
+        {
+            auto w = load_workload(path);
+            for (auto& engine : ENGINES)
+            {
+                auto r = in_child<Result>([&] { return measure(w, engine, repeat, max_cycles); },
+                                          format("Workload '{}' on engine '{}'", w.name, engine.name));
+                double ips = r.seconds > 0 ? r.instructions / r.seconds : 0;
+                double ns = r.instructions > 0 ? r.seconds * 1e9 / r.instructions : 0;
+
+                cout << (first ? "\n" : ",\n");
+                cout << format("    {{ \"workload\": \"{}\", \"engine\": \"{}\", \"instructions\": {}, "
+                               "\"seconds\": {:.6f}, \"instructions_per_second\": {:.0f}, "
+                               "\"ns_per_instruction\": {:.3f}, \"peak_rss_kb\": {} }}",
+                               w.name, engine.name, r.instructions, r.seconds, ips, ns, r.peak_rss_kb);
+                first = false;
+
+                cerr << format("{:<12}{:<12}{:>14} ins {:>10.2f} Mips {:>8.3f} ns/ins\n",
+                               w.name, engine.name, r.instructions, ips / 1e6, ns);
+            }
+        }
+        cout << "\n  ]\n}" << endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Caught exception: '" << e.what() << "'\n";
+        return -1;
+    }
+
+    return 0;
+}
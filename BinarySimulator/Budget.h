@@ -0,0 +1,241 @@
+#pragma once
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include "Motherboard.h"
+
+using namespace std;
+
+// Cycle and stack-depth budgets for labels and VM functions. A label budget bounds the cycles
+// until the label is first reached and the stack depth (SP above its base) until then. A
+// function budget bounds the worst single call: entering the function label starts a call
+// whose return address is the one the VM call sequence stored at SP - 5, and the call ends
+// when PC reaches that address with SP below the entry SP. Nested and recursive calls keep
+// their own frames and the callee depth counts towards the caller.
+struct BUDGET_CHECKER
+{
+    static constexpr uint16_t STACK_BASE = 256;
+
+    enum class KIND : uint8_t
+    {
+        LABEL,
+        FUNCTION
+    };
+
+    struct MEASUREMENT
+    {
+        uint64_t calls = 0;         // times the label was reached or the function returned
+        uint64_t cycles = 0;
+        int32_t depth = 0;
+    };
+
+    struct BUDGET
+    {
+        KIND kind;
+        string name;
+        uint16_t address;
+        uint64_t max_cycles;
+        optional<int32_t> max_depth;
+        MEASUREMENT measured{};
+        optional<MEASUREMENT> baseline;
+    };
+
+    struct FRAME
+    {
+        size_t budget;
+        uint16_t return_address;
+        int16_t sp;
+        uint64_t start;
+        int16_t sp_high_water;
+    };
+
+    vector<BUDGET> budgets;
+    vector<int16_t> entry_index = vector<int16_t>(INSTRUCTION_COUNT, -1);
+    vector<FRAME> frames;
+    int16_t sp_high_water = STACK_BASE;
+
+    static ifstream open(const string& path)
+    {
+        ifstream file{ path };
+        if (!file)
+            throw runtime_error(format("Unable to open file: {}", path));
+        return file;
+    }
+
+    // Accepts "<name> <ROM address>" lines or the assembler's JUMP Locations lines
+    // ("ROM <address> is the location for :<name>"), so its log can be passed as is.
+    static map<string, uint16_t> load_symbols(const string& path)
+    {
+        static constexpr string_view ASSEMBLER_MARKER = " is the location for :";
+
+        auto file = open(path);
+        map<string, uint16_t> symbols;
+        string line;
+        while (std::getline(file, line))
+        {
+            string name;
+            uint32_t address;
+            if (auto marker = line.find(ASSEMBLER_MARKER); line.starts_with("ROM ") && marker != string::npos)
+            {
+                name = line.substr(marker + ASSEMBLER_MARKER.size());
+                if (!(stringstream{ line.substr(4, marker - 4) } >> address))
+                    continue;
+            }
+            else if (line.empty() || line[0] == '#' || !(stringstream{ line } >> name >> address))
+                continue;
+
+            if (address < INSTRUCTION_COUNT)
+                symbols[name] = (uint16_t)address;
+        }
+        return symbols;
+    }
+
+    static void parse_line(const string& line, KIND& kind, string& name, uint64_t& cycles, optional<int32_t>& depth)
+    {
+        stringstream sstr{ line };
+        string word;
+        int32_t d;
+        if (!(sstr >> word >> name >> cycles) || (word != "label" && word != "function"))
+            throw runtime_error(format("Invalid budget line: '{}'", line));
+        kind = word == "label" ? KIND::LABEL : KIND::FUNCTION;
+        depth = sstr >> d ? optional{ d } : nullopt;
+    }
+
+    // Budget format, one per line: label|function <name> <max cycles> [max stack depth]
+    void load_spec(const string& path, const map<string, uint16_t>& symbols)
+    {
+        auto file = open(path);
+        string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            BUDGET budget{};
+            parse_line(line, budget.kind, budget.name, budget.max_cycles, budget.max_depth);
+            auto symbol = symbols.find(budget.name);
+            if (symbol == symbols.end())
+                throw runtime_error(format("Unknown label in budget: '{}'", budget.name));
+            if (entry_index[symbol->second] != -1)
+                throw runtime_error(format("Duplicate budget for ROM {}: '{}'", symbol->second, budget.name));
+
+            budget.address = symbol->second;
+            entry_index[budget.address] = (int16_t)budgets.size();
+            budgets.push_back(budget);
+        }
+    }
+
+    // Baselines use the budget format, as written by save_measurements
+    void load_baseline(const string& path)
+    {
+        auto file = open(path);
+        string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            KIND kind;
+            string name;
+            uint64_t cycles;
+            optional<int32_t> depth;
+            parse_line(line, kind, name, cycles, depth);
+            for (auto& budget : budgets)
+                if (budget.kind == kind && budget.name == name)
+                    budget.baseline = MEASUREMENT{ 1, cycles, depth.value_or(0) };
+        }
+    }
+
+    // Call before the instruction at PC executes, and once more after termination.
+    void observe(const Motherboard& mbd, uint64_t cycles)
+    {
+        auto sp = mbd.dm.ram[0];
+        sp_high_water = std::max(sp_high_water, sp);
+        if (!frames.empty())
+            frames.back().sp_high_water = std::max(frames.back().sp_high_water, sp);
+
+        auto pc = mbd.regs.PC;
+        while (!frames.empty() && frames.back().return_address == pc && sp < frames.back().sp)
+        {
+            auto frame = frames.back();
+            frames.pop_back();
+
+            auto& m = budgets[frame.budget].measured;
+            ++m.calls;
+            m.cycles = std::max(m.cycles, cycles - frame.start);
+            m.depth = std::max<int32_t>(m.depth, frame.sp_high_water - frame.sp);
+            if (!frames.empty())
+                frames.back().sp_high_water = std::max(frames.back().sp_high_water, frame.sp_high_water);
+        }
+
+        if (pc == TERMINATION_PC_ADDRESS || entry_index[pc] == -1)
+            return;
+
+        auto& budget = budgets[entry_index[pc]];
+        if (budget.kind == KIND::FUNCTION)
+        {
+            auto ret = mbd.dm.ram[bit_cast<uint16_t>((int16_t)(sp - 5)) & (RAM_SIZE - 1)];
+            frames.push_back({ (size_t)entry_index[pc], bit_cast<uint16_t>(ret), sp, cycles, sp });
+        }
+        else if (budget.measured.calls++ == 0)
+        {
+            budget.measured.cycles = cycles;
+            budget.measured.depth = sp_high_water - STACK_BASE;
+        }
+    }
+
+    static bool exceeded(const BUDGET& b)
+    {
+        return b.measured.calls == 0 || b.measured.cycles > b.max_cycles ||
+               (b.max_depth && b.measured.depth > *b.max_depth);
+    }
+
+    bool passed() const
+    {
+        return none_of(budgets.begin(), budgets.end(), exceeded);
+    }
+
+    static string delta(uint64_t now, optional<uint64_t> before)
+    {
+        if (!before)
+            return "-";
+        auto d = (int64_t)now - (int64_t)*before;
+        return *before == 0 ? format("{:+}", d) : format("{:+} ({:+.1f}%)", d, 100.0 * d / *before);
+    }
+
+    void report(ostream& out) const
+    {
+        out << format("{:<9}{:<28}{:>7}{:>12}{:>12}{:>20}{:>7}{:>7}{:>12}  {}\n", "Kind", "Name", "Calls", "Cycles",
+                      "Budget", "vs baseline", "Depth", "Budget", "vs baseline", "Status");
+        for (const auto& b : budgets)
+        {
+            const auto& m = b.measured;
+            optional<uint64_t> base_cycles, base_depth;
+            if (b.baseline)
+            {
+                base_cycles = b.baseline->cycles;
+                base_depth = b.baseline->depth;
+            }
+
+            const char* status = m.calls == 0 ? "NOT REACHED" : exceeded(b) ? "OVER BUDGET" : "ok";
+            out << format("{:<9}{:<28}{:>7}{:>12}{:>12}{:>20}{:>7}{:>7}{:>12}  {}\n",
+                          b.kind == KIND::LABEL ? "label" : "function", b.name, m.calls, m.cycles, b.max_cycles,
+                          delta(m.cycles, base_cycles), m.depth, b.max_depth ? to_string(*b.max_depth) : "-",
+                          delta(m.depth, base_depth), status);
+        }
+    }
+
+    // Writes the measurements in the budget format, to serve as the next baseline
+    void save_measurements(ostream& out) const
+    {
+        for (const auto& b : budgets)
+            out << (b.kind == KIND::LABEL ? "label " : "function ") << b.name << " " << b.measured.cycles << " "
+                << b.measured.depth << "\n";
+    }
+};
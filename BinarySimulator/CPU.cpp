@@ -1,447 +1,540 @@
-#include <array>
-#include <bit>
 #include <bitset>
-#include <cstdint>
-#include <format>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <ostream>
-#include <stdexcept>
+#include <set>
 #include <string>
+#include <vector>
+#include "Banking.h"
+#include "Budget.h"
+#include "ConstexprRun.h"
+#include "Devices.h"
+#include "FaultInjection.h"
+#include "Harts.h"
+#include "Intrinsics.h"
+#include "Profiler.h"
+#include "Screen.h"
+#include "Server.h"
+#include "SharedMemory.h"
+#include "Tools.h"
 
 using namespace std;
 
-// Make sure we are using 2's complement representation.
-// https://stackoverflow.com/questions/64842669/how-to-test-if-a-target-has-twos-complement-integers-with-the-c-preprocessor
-#if (-1 & 3) == 1
-static_assert(false, "The system encoding is sign-and-magnitude. This program only compiles on two's complement system.");
-#elif (-1 & 3) == 2
-static_assert(false, "The system encoding is one’s complement. This program only compiles on two's complement system.");
-#elif (-1 & 3) != 3
-static_assert(false, "The system encoding is not possible in C standard. This program only compiles on two's complement system.");
-#endif
-
-const uint16_t RAM_SIZE  = 0x4000;
-const uint16_t SCREEN_SIZE = 0X2000;
-const uint16_t DATA_COUNT = RAM_SIZE + SCREEN_SIZE + 1;
-const uint16_t INSTRUCTION_COUNT = 0x8000;
-
-const auto TERMINATION_PC_ADDRESS = bit_cast<uint16_t>((int16_t) - 1);
-const auto NOP = bit_cast<uint16_t>((int16_t) - 1);
-
-enum class InstructionType : uint8_t
-{
-    A,
-    C,
-    ERROR
-};
-
-struct DATA_MEMORY
+struct Config
 {
-    array<int16_t, RAM_SIZE> ram{};
-    array<int16_t, SCREEN_SIZE> screen{};
-    int16_t keyboard{};
+    string instruction_file_loc{};
+    string memory_dump_loc{};
+    string memory_input_loc{};
+    string intrinsics_loc{};
+    ISA isa = ISA::HACK;
+    string shm_name{};
+    uint64_t shm_interval = 1000;
+    bool server = false;
+    string profile_loc{};
+    uint64_t profile_sample = 64;
+    int screen_scale = 0;
+    int screen_refresh_rate = 30;
+    uint64_t screen_interval = 20000;
+    size_t inject_count = 0;
+    uint64_t inject_seed = 1;
+    uint64_t inject_budget = 2;
+    string inject_report_loc{};
+    string budget_loc{};
+    string symbols_loc{};
+    string budget_baseline_loc{};
+    string budget_save_loc{};
+    vector<string> devices{};
+    vector<string> hart_locs{};
+    uint64_t quantum = 1000;
+    unsigned threads = max(thread::hardware_concurrency(), 1u);
+    bool banked = false;
+    vector<string> tools{};
+    uint64_t bank_cost = 0;
+
+    // Each mode runs its own loop and honours only the flags listed for it, "" is a plain run
+    static inline const map<string, set<string>> MODE_FLAGS = {
+        { "--server", {} },
+        { "--inject", { "--isa", "--inject-seed", "--inject-budget", "--inject-report", "--threads" } },
+        { "--hart", { "--isa", "--quantum", "--threads", "--device" } },
+        { "--banked", { "--isa", "--bank-cost", "--device" } },
+        { "--tool", { "--isa", "--device" } },
+        { "", { "--isa", "--intrinsics", "--device", "--budget", "--symbols", "--budget-baseline", "--budget-save",
+                "--profile", "--profile-sample", "--shm", "--shm-interval", "--screen", "--screen-scale", "--screen-fps",
+                "--screen-interval" } },
+    };
 
-    constexpr int16_t& operator[](uint16_t address)
+    [[noreturn]] static void usage()
     {
-        if ((address & 0b1100'0000'0000'0000) == 0)
-            return ram[address];
+        cerr << "format: ./simulator.out --server" << endl;
+        cerr << "        ./simulator.out [--isa=hack|hackx] --hart rom_loc... [--quantum N] [--threads N] [--device spec]... instruction_file_loc [memory_dump_loc] [memory_input_loc]" << endl;
+        cerr << "        ./simulator.out [--isa=hack|hackx] --banked [--bank-cost N] [--device spec]... instruction_file_loc [memory_dump_loc] [memory_input_loc]" << endl;
+        cerr << "        ./simulator.out [--isa=hack|hackx] --tool spec... [--device spec]... instruction_file_loc [memory_dump_loc] [memory_input_loc]" << endl;
+        cerr << "        ./simulator.out [--isa=hack|hackx] --inject N [--inject-seed S] [--inject-budget F] [--inject-report runs_loc] [--threads N] instruction_file_loc [memory_input_loc]" << endl;
+        cerr << "        ./simulator.out [--isa=hack|hackx] [--intrinsics symbol_map_loc] [--device spec]... [--budget spec_loc --symbols map_loc [--budget-baseline loc] [--budget-save loc]] [--profile report_loc [--profile-sample N]] [--shm name [--shm-interval N]] [--screen [--screen-scale 1-4] [--screen-fps N] [--screen-interval N]] instruction_file_loc [memory_dump_loc] [memory_input_loc]" << endl;
+        cerr << "Each form accepts only the flags it lists." << endl;
+        std::exit(-1);
+    }
 
-        if ((address & 0b1110'0000'0000'0000) == 0b0100'0000'0000'0000)
-            return screen[address & 0b0001'1111'1111'1111];
+    Config(int argc, char** argv)
+    {
+        vector<string> positional;
+        set<string> given;
+        for (int i = 1; i < argc; ++i)
+        {
+            string arg = argv[i];
+            if (arg.starts_with("--"))
+                given.insert(arg.substr(0, arg.find('=')));
+
+            if (arg == "--intrinsics" && i + 1 < argc)
+                intrinsics_loc = argv[++i];
+            else if (arg == "--shm" && i + 1 < argc)
+                shm_name = argv[++i];
+            else if (arg == "--shm-interval" && i + 1 < argc)
+                shm_interval = max<uint64_t>(1, stoull(argv[++i]));
+            else if (arg == "--server")
+                server = true;
+            else if (arg == "--profile" && i + 1 < argc)
+                profile_loc = argv[++i];
+            else if (arg == "--profile-sample" && i + 1 < argc)
+                profile_sample = max<uint64_t>(1, stoull(argv[++i]));
+            else if (arg == "--screen")
+                screen_scale = max(screen_scale, 1);
+            else if (arg == "--screen-scale" && i + 1 < argc)
+                screen_scale = clamp(stoi(argv[++i]), 1, 4);
+            else if (arg == "--screen-fps" && i + 1 < argc)
+                screen_refresh_rate = clamp(stoi(argv[++i]), 1, 1000);
+            else if (arg == "--screen-interval" && i + 1 < argc)
+                screen_interval = max<uint64_t>(1, stoull(argv[++i]));
+            else if (arg == "--inject" && i + 1 < argc)
+                inject_count = stoull(argv[++i]);
+            else if (arg == "--inject-seed" && i + 1 < argc)
+                inject_seed = stoull(argv[++i]);
+            else if (arg == "--inject-budget" && i + 1 < argc)
+                inject_budget = max<uint64_t>(1, stoull(argv[++i]));
+            else if (arg == "--inject-report" && i + 1 < argc)
+                inject_report_loc = argv[++i];
+            else if (arg == "--budget" && i + 1 < argc)
+                budget_loc = argv[++i];
+            else if (arg == "--symbols" && i + 1 < argc)
+                symbols_loc = argv[++i];
+            else if (arg == "--budget-baseline" && i + 1 < argc)
+                budget_baseline_loc = argv[++i];
+            else if (arg == "--budget-save" && i + 1 < argc)
+                budget_save_loc = argv[++i];
+            else if (arg == "--hart" && i + 1 < argc)
+                hart_locs.push_back(argv[++i]);
+            else if (arg == "--quantum" && i + 1 < argc)
+                quantum = max<uint64_t>(1, stoull(argv[++i]));
+            else if (arg == "--threads" && i + 1 < argc)
+                threads = max(stoi(argv[++i]), 1);
+            else if (arg == "--banked")
+                banked = true;
+            else if (arg == "--bank-cost" && i + 1 < argc)
+                bank_cost = stoull(argv[++i]);
+            else if (arg == "--tool" && i + 1 < argc)
+                tools.push_back(argv[++i]);
+            else if (arg == "--device" && i + 1 < argc)
+                devices.push_back(argv[++i]);
+            else if (arg == "--isa=hackx")
+                isa = ISA::HACKX;
+            else if (arg == "--isa=hack")
+                isa = ISA::HACK;
+            else
+                positional.push_back(arg);
+        }
 
-        if (address == 24576)
-            return keyboard;
+        if (given.contains("--inject") && inject_count == 0)
+        {
+            cerr << "--inject needs at least one fault" << endl;
+            std::exit(-1);
+        }
 
-        throw std::runtime_error(format("Trying to access invalid data memory location: 0x{:04X}\n",
-                                        address));
-    }
+        // main picks the mode in the same order
+        string mode = server ? "--server" : inject_count > 0 ? "--inject" : !hart_locs.empty() ? "--hart" :
+                      banked ? "--banked" : !tools.empty() ? "--tool" : "";
+        const auto& honoured = MODE_FLAGS.at(mode);
+        for (const auto& flag : given)
+        {
+            if (flag == mode || honoured.contains(flag))
+                continue;
+
+            if (!mode.empty())
+                cerr << flag << " cannot be used with " << mode << endl;
+            else if (auto owner = find_if(MODE_FLAGS.begin(), MODE_FLAGS.end(), [&](auto& m) { return m.second.contains(flag); });
+                     owner != MODE_FLAGS.end())
+                cerr << flag << " is only used with " << owner->first << endl;
+            else
+                cerr << "Unknown flag " << flag << endl;
+            usage();
+        }
 
-    constexpr const int16_t operator[](uint16_t address) const
-    {
-        if ((address & 0b1100'0000'0000'0000) == 0)
-            return ram[address];
+        if (server)
+            return;
 
-        if ((address & 0b1110'0000'0000'0000) == 0b0100'0000'0000'0000)
-            return screen[address & 0b0001'1111'1111'1111];
+        if (!budget_loc.empty() && symbols_loc.empty())
+        {
+            cerr << "--budget requires a --symbols map of label addresses" << endl;
+            std::exit(-1);
+        }
 
-        if (address == 24576)
-            return keyboard;
+        if (positional.size() < 1 || positional.size() > (inject_count > 0 ? 2u : 3u))
+            usage();
 
-        throw std::runtime_error(format("Trying to access invalid data memory location: 0x{:04X}\n",
-                                        address));
+        instruction_file_loc = positional[0];
+        if (inject_count > 0)
+        {
+            if (positional.size() == 2)
+                memory_input_loc = positional[1];
+            return;
+        }
+        if (positional.size() >= 2)
+            memory_dump_loc = positional[1];
+        if (positional.size() == 3)
+            memory_input_loc = positional[2];
     }
-};
 
-struct INSTRUCTION_MEMORY
-{
-    array<uint16_t, INSTRUCTION_COUNT> rom{};
-
-    constexpr uint16_t& operator[](uint16_t address) noexcept
+    void load_motherboard(Motherboard& mbd) const
     {
-        return rom.at(address);
+        mbd.isa = isa;
+        load_binary_file(memory_input_loc, [&](size_t index, uint16_t val) {
+            mbd.dm[index] = bit_cast<int16_t>(val);
+        });
+
+        load_binary_file(instruction_file_loc, [&](size_t index, uint16_t val) {
+            mbd.im[index] = bit_cast<int16_t>(val);
+        }, rom_image_flags(isa));
     }
 
-    constexpr const uint16_t& operator[](uint16_t address) const noexcept
+    void load_intrinsics(INTRINSICS& intrinsics) const
     {
-        return rom.at(address);
+        if (!intrinsics_loc.empty())
+            intrinsics.load_symbol_map(intrinsics_loc);
     }
-};
-
-struct REGISTERS
-{
-    int16_t D {};
-    int16_t A {};
-    uint16_t PC {};
-};
-
-[[nodiscard]]
-constexpr InstructionType get_instruction_type(uint16_t ins)
-{
-    bool A_instruction = !(ins >> 15);
-    bool D_instruction = ((ins >> 13) == 7);
-
-    if (A_instruction == D_instruction)
-        return InstructionType::ERROR;
-
-    if (A_instruction)
-        return InstructionType::A;
-
-    return InstructionType::C;
-}
-
-[[nodiscard]]
-constexpr int16_t ALU_a_0(REGISTERS& regs, uint8_t c)
-{
-    auto& A = regs.A;
-    auto& D = regs.D;
 
-    switch (c)
+    static void dump_memory(ostream& out, const DATA_MEMORY& dm)
     {
-        case 0b101010:
-            return 0;
-
-        case 0b111111:
-            return 1;
-
-        case 0b111010:
-            return -1;
-
-        case 0b001100:
-            return D;
-
-        case 0b110000:
-            return A;
-
-        case 0b001101:
-            return (int16_t)~D;
-
-        case 0b110001:
-            return (int16_t)~A;
-
-        case 0b001111:
-            return (int16_t)-D;
-
-        case 0b110011:
-            return (int16_t)-A;
-
-        case 0b011111:
-            return (int16_t)(D + 1);
-
-        case 0b110111:
-            return (int16_t)(A + 1);
-
-        case 0b001110:
-            return (int16_t)(D - 1);
-
-        case 0b110010:
-            return (int16_t)(A - 1);
-
-        case 0b000010:
-            return (int16_t)(D + A);
-
-        case 0b010011:
-            return (int16_t)(D - A);
-
-        case 0b000111:
-            return (int16_t)(A - D);
-
-        case 0b000000:
-            return (int16_t)(A & D);
-
-        case 0b010101:
-            return (int16_t)(D | A);
+        out << "Memory Contents: " << endl;
 
-        default:
-            throw std::runtime_error(format("Invalid instruction passed for comp bits: 0b0{:06b}\n",
-                                            c));
+        for (int i = 0; i < DATA_COUNT; ++i)
+            if (dm[i] != 0)
+                out << i << "\t" << bitset<16>(dm[i]) << "\t(" << dm[i] << ")" << endl;
     }
-}
 
-[[nodiscard]]
-constexpr int16_t ALU_a_1(REGISTERS& regs, DATA_MEMORY& dm, uint8_t c)
-{
-    auto& M = dm[bit_cast<uint16_t>(regs.A)];
-    auto& D = regs.D;
-
-    switch (c)
+    template <class DM, class IM>
+    void dump_contents(BASIC_MOTHERBOARD<DM, IM>& mbd) const
     {
-        case 0b110000:
-            return M;
-
-        case 0b110001:
-            return (int16_t)~M;
-
-        case 0b110011:
-            return (int16_t)-M;
-
-        case 0b110111:
-            return (int16_t)(M + 1);
-
-        case 0b110010:
-            return (int16_t)(M - 1);
-
-        case 0b000010:
-            return (int16_t)(D + M);
-
-        case 0b010011:
-            return (int16_t)(D - M);
-
-        case 0b000111:
-            return (int16_t)(M - D);
-
-        case 0b000000:
-            return (int16_t)(M & D);
-
-        case 0b010101:
-            return (int16_t)(D | M);
+        if (memory_dump_loc.empty())
+            return;
 
-        default:
-            throw std::runtime_error(format("Invalid instruction passed for comp bits: 0b1{:06b}\n",
-                                            c));
+        // dump
+        ofstream out{ memory_dump_loc };
+        out << "A:  " << mbd.regs.A << endl;
+        out << "D:  " << mbd.regs.D << endl;
+        out << "PC: " << mbd.regs.PC << endl;
+        dump_memory(out, mbd.dm);
     }
-}
 
-[[nodiscard]]
-constexpr bool should_jump(uint8_t j, int16_t alu_out)
-{
-    switch (j & 0b111)
+    void dump_contents(const MULTI_HART& machine) const
     {
-        case 0b000:
-            return false;
-
-        case 0b001:
-            return alu_out > 0;
-
-        case 0b010:
-            return alu_out == 0;
-
-        case 0b011:
-            return alu_out >= 0;
-
-        case 0b100:
-            return alu_out < 0;
-
-        case 0b101:
-            return alu_out != 0;
-
-        case 0b110:
-            return alu_out <= 0;
+        if (memory_dump_loc.empty())
+            return;
 
-        case 0b111:
-            return true;
+        ofstream out{ memory_dump_loc };
+        for (size_t h = 0; h < machine.harts.size(); ++h)
+        {
+            const auto& regs = machine.harts[h].regs;
+            out << "Hart " << h << " A:  " << regs.A << "  D:  " << regs.D << "  PC: " << regs.PC
+                << "  cycles: " << machine.harts[h].cycles << endl;
+        }
+        dump_memory(out, machine.dm);
     }
+};
 
-    throw std::runtime_error("Switch should have covered all jump cases.");
-}
-
-struct Motherboard
+int main(int argc, char** argv)
 {
-    REGISTERS regs{};
-    DATA_MEMORY dm{};
-    INSTRUCTION_MEMORY im{};
+    Config config(argc, argv);
 
-    struct STATUS
+    if (config.server)
     {
-        const REGISTERS& registers;
-        const uint16_t ins;
-        const optional<int16_t> memory{};
-    };
-
-    struct sentinel {};
+        SERVER(stdin, stdout).serve();
+        return 0;
+    }
 
-    struct iterator
+    if (config.inject_count > 0)
     {
-        DATA_MEMORY& dm;
-        const INSTRUCTION_MEMORY& im;
-        REGISTERS& regs;
+        auto initial = make_unique<Motherboard>();
+        config.load_motherboard(*initial);
 
-        constexpr bool operator!=(sentinel) const { return regs.PC != TERMINATION_PC_ADDRESS; }
-        constexpr iterator& operator++()
-        {
-            uint16_t ins = im[regs.PC];
-            while (ins == NOP)
-                ins = im[regs.PC];
+        FAULT_INJECTOR injector(*initial, config.inject_budget);
+        injector.generate(config.inject_count, config.inject_seed);
+        injector.run(config.threads);
+        injector.report(cout);
 
-            auto ins_type = get_instruction_type(ins);
-            if (ins_type == InstructionType::A)
-            {
-                regs.A = bit_cast<int16_t>(ins);
-                regs.PC = regs.PC + 1;
-                return *this;
-            }
-            if (ins_type != InstructionType::C)
-                throw runtime_error(format("Invalid instruction type encountered: 0x{:04X}", ins));
+        if (!config.inject_report_loc.empty())
+        {
+            ofstream out{ config.inject_report_loc };
+            injector.write_runs(out);
+        }
+        return 0;
+    }
 
+    if (!config.hart_locs.empty())
+    {
+        // Hart 0 runs the positional ROM, the others one --hart ROM each
+        auto machine = make_unique<MULTI_HART>(config.hart_locs.size() + 1, config.quantum, config.threads);
+        load_binary_file(config.memory_input_loc, [&](size_t index, uint16_t val) {
+            machine->dm[index] = bit_cast<int16_t>(val);
+        });
+        for (size_t h = 0; h < machine->harts.size(); ++h)
+        {
+            auto& hart = machine->harts[h];
+            hart.isa = config.isa;
+            load_binary_file(h == 0 ? config.instruction_file_loc : config.hart_locs[h - 1], [&](size_t index, uint16_t val) {
+                (*hart.im)[index] = val;
+            }, rom_image_flags(config.isa));
+        }
 
-            uint8_t j = ins & 07;
-            uint8_t d = (ins & 070) >> 3;
-            uint8_t c = (ins & 07700) >> 6;
-            uint8_t a = (ins & 010000) >> 12;
+        DEVICE_MAP devices{};
+        for (const auto& spec : config.devices)
+        {
+            auto base = devices.attach(spec, machine->executed);
+            const auto& device = *devices.mappings.back().device;
+            cerr << "Device " << device.name() << " at " << base << "-" << base + device.size() - 1 << endl;
+        }
+        if (!devices.mappings.empty())
+            machine->dm.devices = &devices;
 
-            // get value
-            int16_t alu_out = (a == 0 ? ALU_a_0(regs, c) : ALU_a_1(regs, dm, c));
+        try
+        {
+            machine->run();
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Caught exception: '" << e.what() << "'\n";
+            std::terminate();
+        }
 
-            // get jump
-            if (should_jump(j, alu_out))
-                regs.PC = regs.A;	// PC = PC + 1 will be executed later
-            else
-                regs.PC += 1;
+        std::cerr << "\nFINISHED EXECUTION IN " << machine->rounds << " ROUNDS (" << machine->parallel_rounds
+                  << " IN PARALLEL)" << std::endl;
+        for (size_t h = 0; h < machine->harts.size(); ++h)
+            std::cerr << "HART " << h << ": " << machine->harts[h].cycles << " CYCLES" << std::endl;
 
-            // get destination
-            if (d & 0b001)
-                dm[regs.A] = alu_out;
-            if (d & 0b010)
-                regs.D = alu_out;
-            if (d & 0b100)
-                regs.A = alu_out;
+        config.dump_contents(*machine);
+        return 0;
+    }
 
-            return *this;
+    if (config.banked)
+    {
+        auto mbd = make_unique<BANKED_MOTHERBOARD>();
+        mbd->isa = config.isa;
+        load_binary_file(config.memory_input_loc, [&](size_t index, uint16_t val) {
+            mbd->dm[index] = bit_cast<int16_t>(val);
+        });
+        load_binary_file(config.instruction_file_loc, [&](size_t index, uint16_t val) {
+            mbd->im.load(index, val);
+        }, rom_image_flags(config.isa, true));
+
+        uint64_t cycles = 0;
+        DEVICE_MAP devices{};
+        auto bank_select = make_unique<BANK_SELECT_DEVICE>(mbd->im, cycles, config.bank_cost);
+        auto& bank_register = *bank_select;
+        devices.attach(move(bank_select), BANK_SELECT_BASE);
+        for (const auto& spec : config.devices)
+        {
+            auto base = devices.attach(spec, cycles);
+            const auto& device = *devices.mappings.back().device;
+            cerr << "Device " << device.name() << " at " << base << "-" << base + device.size() - 1 << endl;
         }
+        mbd->dm.devices = &devices;
 
-        const constexpr STATUS operator*() const
+        try
         {
-            if (regs.A == bit_cast<int16_t>(TERMINATION_PC_ADDRESS))
-                return { regs, im[regs.PC] };
-
-            return { regs, im[regs.PC], dm[regs.A] };
+            for (auto it = mbd->begin(); it != mbd->end(); ++it)
+                ++cycles;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Caught exception: '" << e.what() << "'\n";
+            std::terminate();
         }
-    };
-
-    constexpr iterator begin() { return iterator{ this->dm, this->im, this->regs }; }
-    static constexpr sentinel end() { return {}; }
-};
-
-static_assert(sizeof(DATA_MEMORY) == (DATA_COUNT << 1));
-static_assert(sizeof(INSTRUCTION_MEMORY) == (INSTRUCTION_COUNT << 1));
-static_assert(sizeof(REGISTERS) == 6);
-static_assert(sizeof(Motherboard) == sizeof(DATA_MEMORY) + sizeof(INSTRUCTION_MEMORY) + sizeof(REGISTERS));
 
-struct Config
-{
-    string instruction_file_loc{};
-    string memory_dump_loc{};
-    string memory_input_loc{};
+        std::cerr << "\nFINISHED EXECUTION IN " << cycles << " CYCLES (" << mbd->im.bank_count() << " ROM BANKS, "
+                  << bank_register.switches << " BANK SWITCHES)" << std::endl;
+        config.dump_contents(*mbd);
+        return 0;
+    }
 
-    static void load_file(string path, const function<void(size_t, uint16_t)>& f)
+    if (!config.tools.empty())
     {
-        if (path.empty())
-            return;
-
-        ifstream file{ path };
-
-        if (!file)
-            throw runtime_error(format("Unable to open file: {}", path));
+        // Analyses run on the predecoded engine, probing only the instructions they observe
+        auto mbd = make_unique<Motherboard>();
+        config.load_motherboard(*mbd);
 
-        string line;
-        int i = 0;
-        while (std::getline(file, line))
+        uint64_t cycles = 0;
+        DEVICE_MAP devices{};
+        for (const auto& spec : config.devices)
         {
-            uint16_t val = 0;
-            for (char c : line)
-            {
-                if (c != '0' && c != '1')
-                    continue;
+            auto base = devices.attach(spec, cycles);
+            const auto& device = *devices.mappings.back().device;
+            cerr << "Device " << device.name() << " at " << base << "-" << base + device.size() - 1 << endl;
+        }
+        if (!devices.mappings.empty())
+            mbd->dm.devices = &devices;
 
-                val <<= 1;
-                val |= (c - '0');
-            }
-            f(i, val);
-            ++i;
+        INSTRUMENTATION instrumentation{};
+        vector<unique_ptr<TOOL>> tools;
+        for (const auto& spec : config.tools)
+        {
+            tools.push_back(make_tool(spec));
+            tools.back()->attach(instrumentation);
         }
-    }
+        auto rom = make_unique<PREDECODED_ROM>();
+        rom->decode(mbd->im, mbd->isa, &instrumentation);
 
-    Config(int argc, char** argv)
-    {
-        if (argc < 2 || argc > 4)
+        try
         {
-            cerr << "format: ./simulator.out instruction_file_loc [memory_dump_loc] [memory_input_loc]" << endl;
-            std::exit(-1);
+            // The timer device reads the cycle count between chunks
+            while (mbd->regs.PC != TERMINATION_PC_ADDRESS)
+                cycles += rom->run(*mbd, devices.mappings.empty() ? UINT64_MAX : 1);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Caught exception: '" << e.what() << "'\n";
+            std::terminate();
         }
 
-        instruction_file_loc = argv[1];
-        if (argc >= 3)
-            memory_dump_loc = argv[2];
-        if (argc == 4)
-            memory_input_loc = argv[3];
+        std::cerr << "\nFINISHED EXECUTION IN " << cycles << " CYCLES" << std::endl;
+        for (const auto& tool : tools)
+        {
+            tool->report(cout);
+            cout << endl;
+        }
+        config.dump_contents(*mbd);
+        return 0;
     }
 
-    void load_motherboard(Motherboard& mbd) const
-    {
-        load_file(memory_input_loc, [&](size_t index, uint16_t val) {
-            mbd.dm[index] = bit_cast<int16_t>(val);
-        });
+    // With --shm the motherboard lives in the shared-memory segment itself
+    Motherboard local{};
+    unique_ptr<SHARED_MEMORY> shm;
+    if (!config.shm_name.empty())
+        shm = make_unique<SHARED_MEMORY>(config.shm_name);
+    Motherboard& mbd = shm ? *shm->mbd : local;
 
-        load_file(instruction_file_loc, [&](size_t index, uint16_t val) {
-            mbd.im[index] = bit_cast<int16_t>(val);
-        });
-    }
+    INTRINSICS intrinsics{};
+    config.load_motherboard(mbd);
+    config.load_intrinsics(intrinsics);
 
-    void dump_contents(Motherboard& mbd) const
+    uint64_t cycles = 0;
+    DEVICE_MAP devices{};
+    for (const auto& spec : config.devices)
     {
-        if (memory_dump_loc.empty())
-            return;
+        auto base = devices.attach(spec, cycles);
+        const auto& device = *devices.mappings.back().device;
+        cerr << "Device " << device.name() << " at " << base << "-" << base + device.size() - 1 << endl;
+    }
+    if (!devices.mappings.empty())
+        mbd.dm.devices = &devices;
 
-        // dump
-        ofstream out{ memory_dump_loc };
-        out << "A:  " << mbd.regs.A << endl;
-        out << "D:  " << mbd.regs.D << endl;
-        out << "PC: " << mbd.regs.PC << endl;
-        out << "Memory Contents: " << endl;
+    unique_ptr<PROFILER> profiler;
+    if (!config.profile_loc.empty())
+        profiler = make_unique<PROFILER>(config.profile_sample);
 
-        for (int i = 0; i < DATA_COUNT; ++i)
-            if (mbd.dm[i] != 0)
-                out << i << "\t" << bitset<16>(mbd.dm[i]) << "\t(" << mbd.dm[i] << ")" << endl;
+    unique_ptr<BUDGET_CHECKER> budget;
+    if (!config.budget_loc.empty())
+    {
+        budget = make_unique<BUDGET_CHECKER>();
+        budget->load_spec(config.budget_loc, BUDGET_CHECKER::load_symbols(config.symbols_loc));
+        if (!config.budget_baseline_loc.empty())
+            budget->load_baseline(config.budget_baseline_loc);
     }
-};
 
-int main(int argc, char** argv)
-{
-    Motherboard mbd{};
-    Config config(argc, argv);
-    config.load_motherboard(mbd);
+    unique_ptr<SCREEN_RENDERER> screen;
+    if (config.screen_scale > 0)
+        screen = make_unique<SCREEN_RENDERER>(config.screen_scale, config.screen_refresh_rate);
 
+#ifdef DEBUG_MODE
     std::cerr << std::format("{:<23}{:<13}{:<13}{:<13}{}\n",
                              "Instruction (Executed)", "Register PC",
                              "Register A", "Register D", "Memory[A]");
+#endif
 
+    uint64_t next_publish = 0;
+    uint64_t next_frame = 0;
     try
     {
-        for (const auto &[R, I, M] : mbd)
+        for (auto it = mbd.begin(); it != mbd.end();)
+        {
+            if (shm && cycles >= next_publish)
+            {
+                shm->publish(cycles);
+                next_publish = cycles + config.shm_interval;
+            }
+
+            if (screen && cycles >= next_frame)
+            {
+                mbd.dm.keyboard = screen->publish(mbd.dm);
+                next_frame = cycles + config.screen_interval;
+            }
+
+            if (budget)
+                budget->observe(mbd, cycles);
+
+            if (!intrinsics.empty() && intrinsics.trap(mbd, cycles))
+                continue;
+
+#ifdef DEBUG_MODE
+            const auto &[R, I, M] = *it;
             std::cerr << std::format("{:<23}{:<13}{:<13}{:<13}{}\n", I, R.PC, R.A, R.D, (M.has_value() ? to_string(M.value()) : "-"));
+#endif
+            ++it;
+            ++cycles;
+            if (profiler)
+                profiler->after(mbd);
+        }
     }
     catch (const std::exception& e)
     {
+        screen.reset();
         std::cerr << "Caught exception: '" << e.what() << "'\n";
         std::terminate();
     }
 
-    std::cerr << "\nFINISHED EXECUTION" << std::endl;
+    if (shm)
+        shm->publish(cycles, true);
+
+    if (screen)
+    {
+        screen->publish(mbd.dm);
+        screen.reset();
+    }
+
+    std::cerr << "\nFINISHED EXECUTION IN " << cycles << " CYCLES" << std::endl;
+
+    if (profiler)
+    {
+        ofstream out{ config.profile_loc };
+        profiler->report(out);
+    }
 
 	cerr << "Flushing output to a dump file." << endl;
     config.dump_contents(mbd);
 	cerr << "Flushing output done." << endl;
 
+    if (budget)
+    {
+        budget->observe(mbd, cycles);
+        budget->report(cout);
+        if (!config.budget_save_loc.empty())
+        {
+            ofstream out{ config.budget_save_loc };
+            budget->save_measurements(out);
+        }
+        if (!budget->passed())
+            return 1;
+    }
+
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include <algorithm>
+#include "Motherboard.h"
+
+// Constant-evaluable execution of small ROMs through step(), the function behind
+// Motherboard::iterator. Faults end the run and are reported in halt, so a run can be used
+// in static_assert. Execution stops after budget instructions.
+struct CONSTEXPR_RUN
+{
+    // the faults keep the values step() returns them with
+    enum class HALT : uint8_t
+    {
+        INVALID_INSTRUCTION = (uint8_t)STEP_FAULT::INVALID_INSTRUCTION,
+        INVALID_ADDRESS = (uint8_t)STEP_FAULT::INVALID_ADDRESS,
+        PC_OUT_OF_ROM = (uint8_t)STEP_FAULT::PC_OUT_OF_ROM,
+        FINISHED,
+        BUDGET_EXHAUSTED
+    };
+
+    HALT halt = HALT::BUDGET_EXHAUSTED;
+    uint64_t cycles{};
+    REGISTERS regs{};
+    DATA_MEMORY dm{};
+};
+
+// Instructions past the end of the ROM are zero, as in INSTRUCTION_MEMORY
+template <size_t N>
+[[nodiscard]]
+constexpr INSTRUCTION_MEMORY constexpr_rom(const array<uint16_t, N>& rom)
+{
+    static_assert(N <= INSTRUCTION_COUNT);
+    INSTRUCTION_MEMORY im{};
+    copy(rom.begin(), rom.end(), im.rom.begin());
+    return im;
+}
+
+template <size_t N>
+[[nodiscard]]
+constexpr CONSTEXPR_RUN run_constexpr(const array<uint16_t, N>& rom, uint64_t budget, ISA isa = ISA::HACK)
+{
+    CONSTEXPR_RUN run{};
+    auto im = constexpr_rom(rom);
+    for (; run.cycles < budget && run.regs.PC != TERMINATION_PC_ADDRESS; ++run.cycles)
+        if (auto fault = step(run.regs, run.dm, im, isa); fault != STEP_FAULT::NONE)
+        {
+            run.halt = (CONSTEXPR_RUN::HALT)fault;
+            return run;
+        }
+
+    if (run.regs.PC == TERMINATION_PC_ADDRESS)
+        run.halt = CONSTEXPR_RUN::HALT::FINISHED;
+    return run;
+}
+
+// C-instruction from the 7 a-comp bits, dest and jump
+[[nodiscard]]
+constexpr uint16_t encode_c(uint8_t comp, uint8_t dest = 0, uint8_t jump = 0)
+{
+    return (uint16_t)(0b111 << 13 | comp << 6 | dest << 3 | jump);
+}
+
+namespace constexpr_checks
+{
+    // The Hack ALU as specified by its control bits
+    constexpr int16_t hack_alu(uint8_t c, int16_t x, int16_t y)
+    {
+        if (c & 0b100000) x = 0;
+        if (c & 0b010000) x = (int16_t)~x;
+        if (c & 0b001000) y = 0;
+        if (c & 0b000100) y = (int16_t)~y;
+        int16_t out = (c & 0b000010) ? (int16_t)(x + y) : (int16_t)(x & y);
+        return (c & 0b000001) ? (int16_t)~out : out;
+    }
+
+    // Every valid comp code against the control-bit definition, for a grid of operands
+    constexpr bool alu_matches_specification()
+    {
+        constexpr int16_t OPERANDS[] = { 0, 1, -1, 2, -2, 7, 1234, -1234, 32767, -32768, 0x5555, 0x2AAA };
+        for (uint8_t a = 0; a < 2; ++a)
+            for (uint8_t c = 0; c < 64; ++c)
+            {
+                if (!is_valid_comp(a, c))
+                    continue;
+
+                for (auto D : OPERANDS)
+                    for (auto y : OPERANDS)
+                    {
+                        REGISTERS regs{ D, a ? (int16_t)0 : y, 0 };
+                        DATA_MEMORY dm{};
+                        dm[0] = y;
+                        int16_t out = a ? ALU_a_1(regs, dm, c) : ALU_a_0(regs, c);
+                        if (out != hack_alu(c, D, y))
+                            return false;
+                    }
+            }
+        return true;
+    }
+
+    constexpr bool jumps_match_specification()
+    {
+        constexpr int16_t VALUES[] = { -32768, -2, -1, 0, 1, 2, 32767 };
+        for (uint8_t j = 0; j < 8; ++j)
+            for (auto out : VALUES)
+            {
+                bool expected = ((j & 0b100) && out < 0) || ((j & 0b010) && out == 0) || ((j & 0b001) && out > 0);
+                if (should_jump(j, out) != expected)
+                    return false;
+            }
+        return true;
+    }
+
+    static_assert(alu_matches_specification());
+    static_assert(jumps_match_specification());
+
+    // RAM[2] = RAM[0] * RAM[1] by repeated addition, with RAM[0] = 6 and RAM[1] = 7
+    constexpr array<uint16_t, 26> MULTIPLY = {
+        6, encode_c(0b0110000, 0b010), 0, encode_c(0b0001100, 0b001),
+        7, encode_c(0b0110000, 0b010), 1, encode_c(0b0001100, 0b001),
+        2, encode_c(0b0101010, 0b001),
+        NOP, NOP,                                                       // (LOOP) at 12
+        0, encode_c(0b1110000, 0b010),
+        24, encode_c(0b0001100, 0b000, 0b010),                          // D;JEQ END
+        1, encode_c(0b1110000, 0b010),
+        2, encode_c(0b1000010, 0b001),                                  // M = D + M
+        0, encode_c(0b1110010, 0b001),                                  // M = M - 1
+        12, encode_c(0b0101010, 0b000, 0b111),
+        encode_c(0b0111010, 0b100), encode_c(0b0101010, 0b000, 0b111),  // (END) A = -1; 0;JMP
+    };
+
+    constexpr auto multiply_run = run_constexpr(MULTIPLY, 1000);
+    static_assert(multiply_run.halt == CONSTEXPR_RUN::HALT::FINISHED);
+    static_assert(multiply_run.dm[2] == 42 && multiply_run.dm[0] == 0);
+
+    // The same program through Motherboard::iterator
+    constexpr bool iterator_runs_multiply()
+    {
+        Motherboard mbd{};
+        mbd.im = constexpr_rom(MULTIPLY);
+        auto cycles = run_reference(mbd, 1000);
+        return mbd.regs.PC == TERMINATION_PC_ADDRESS && cycles == multiply_run.cycles && mbd.dm[2] == 42;
+    }
+    static_assert(iterator_runs_multiply());
+
+    // 0;JMP back to itself never finishes
+    static_assert(run_constexpr(array<uint16_t, 2>{ 0, encode_c(0b0101010, 0b000, 0b111) }, 100).halt ==
+                  CONSTEXPR_RUN::HALT::BUDGET_EXHAUSTED);
+
+    // M = 1 one word past the keyboard
+    static_assert(run_constexpr(array<uint16_t, 2>{ DATA_COUNT, encode_c(0b0111111, 0b001) }, 100).halt ==
+                  CONSTEXPR_RUN::HALT::INVALID_ADDRESS);
+
+    // a = 1 with a comp code that is only valid for a = 0
+    static_assert(run_constexpr(array<uint16_t, 1>{ encode_c(0b1101010, 0b010) }, 100).halt ==
+                  CONSTEXPR_RUN::HALT::INVALID_INSTRUCTION);
+
+    // HackX: D = 6 * 7 << 1, only with the extension enabled
+    constexpr array<uint16_t, 6> HACKX_MULTIPLY = {
+        6, encode_c(0b0110000, 0b010), 7, encode_c(0b0000110, 0b010), encode_c(0b0000001, 0b010), 0,
+    };
+    static_assert(run_constexpr(HACKX_MULTIPLY, 5, ISA::HACKX).regs.D == 84);
+    static_assert(run_constexpr(HACKX_MULTIPLY, 5).halt == CONSTEXPR_RUN::HALT::INVALID_INSTRUCTION);
+}
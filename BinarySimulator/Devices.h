@@ -0,0 +1,225 @@
+#pragma once
+#include <bitset>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <utility>
+#include <vector>
+#include "Motherboard.h"
+
+using namespace std;
+
+// First address of the device window, the word after the keyboard
+const uint16_t DEVICE_BASE = DATA_COUNT;
+
+// A memory-mapped device occupying size() consecutive words of the device window.
+// Offsets are relative to the address the device is attached at.
+struct DEVICE
+{
+    virtual ~DEVICE() = default;
+    virtual const char* name() const = 0;
+    virtual uint16_t size() const = 0;
+    virtual int16_t read(uint16_t offset) = 0;
+    virtual void write(uint16_t offset, int16_t value) = 0;
+};
+
+// Cycle counter. Reading word 0 latches the cycles elapsed since the last reset and returns
+// bits 0-15, words 1-3 return bits 16-63 of the latched value. Writing any word resets it.
+struct TIMER_DEVICE : DEVICE
+{
+    const uint64_t& cycles;
+    uint64_t base = 0;
+    uint64_t latched = 0;
+
+    explicit TIMER_DEVICE(const uint64_t& cycles) : cycles(cycles) {}
+
+    const char* name() const override { return "timer"; }
+    uint16_t size() const override { return 4; }
+
+    int16_t read(uint16_t offset) override
+    {
+        if (offset == 0)
+            latched = cycles - base;
+        return bit_cast<int16_t>((uint16_t)(latched >> (16 * offset)));
+    }
+
+    void write(uint16_t, int16_t) override
+    {
+        base = cycles;
+        latched = 0;
+    }
+};
+
+// Host file stream, one word per access. Reading word 0 returns the next word of the input
+// file (0 once it is exhausted), word 1 reads 1 while input words remain. Writing word 0
+// appends a word to the output file. Both files use the memory file format, one word of
+// binary digits per line.
+struct FILE_DEVICE : DEVICE
+{
+    ifstream input;
+    ofstream output;
+    optional<uint16_t> next;
+
+    FILE_DEVICE(const string& input_loc, const string& output_loc)
+    {
+        if (!input_loc.empty())
+        {
+            input.open(input_loc);
+            if (!input)
+                throw runtime_error(format("Unable to open file: {}", input_loc));
+        }
+        if (!output_loc.empty())
+        {
+            output.open(output_loc);
+            if (!output)
+                throw runtime_error(format("Unable to open file: {}", output_loc));
+        }
+        fetch();
+    }
+
+    const char* name() const override { return "file"; }
+    uint16_t size() const override { return 2; }
+
+    void fetch()
+    {
+        string line;
+        if (input.is_open() && std::getline(input, line))
+            next = parse_binary_word(line);
+        else
+            next.reset();
+    }
+
+    int16_t read(uint16_t offset) override
+    {
+        if (offset == 1)
+            return next.has_value();
+
+        if (!next)
+            return 0;
+        auto value = bit_cast<int16_t>(*next);
+        fetch();
+        return value;
+    }
+
+    void write(uint16_t offset, int16_t value) override
+    {
+        if (offset != 0)
+            throw runtime_error(format("File device: word {} is read-only", offset));
+        if (!output.is_open())
+            throw runtime_error("File device: no output file attached");
+        output << bitset<16>(bit_cast<uint16_t>(value)) << '\n';
+    }
+};
+
+// Pseudo-random words. Reading returns the next 16 bits of a Mersenne Twister, writing
+// reseeds it with the written value so runs are reproducible.
+struct RANDOM_DEVICE : DEVICE
+{
+    mt19937 rng;
+
+    explicit RANDOM_DEVICE(uint32_t seed) : rng(seed) {}
+
+    const char* name() const override { return "random"; }
+    uint16_t size() const override { return 1; }
+
+    int16_t read(uint16_t) override { return bit_cast<int16_t>((uint16_t)rng()); }
+    void write(uint16_t, int16_t value) override { rng.seed(bit_cast<uint16_t>(value)); }
+};
+
+// Test-and-set register for harts sharing the data memory. Reading returns the value and
+// sets it to 1 in the same access, so a hart that reads 0 holds the lock; writing 0
+// releases it. Only one hart accesses devices at a time (see Harts.h).
+struct LOCK_DEVICE : DEVICE
+{
+    int16_t value = 0;
+
+    const char* name() const override { return "lock"; }
+    uint16_t size() const override { return 1; }
+
+    int16_t read(uint16_t) override { return exchange(value, (int16_t)1); }
+    void write(uint16_t, int16_t v) override { value = v; }
+};
+
+// The device window. Devices are attached at an explicit address or after the previous one.
+struct DEVICE_MAP final : DEVICE_BUS
+{
+    struct MAPPING
+    {
+        uint16_t base;
+        uint16_t size;
+        unique_ptr<DEVICE> device;
+    };
+
+    vector<MAPPING> mappings;
+    uint32_t next_base = DEVICE_BASE;
+
+    uint16_t attach(unique_ptr<DEVICE> device, optional<uint16_t> address = nullopt)
+    {
+        uint32_t base = address.value_or((uint16_t)next_base);
+        uint32_t end = base + device->size();
+        if (base < DEVICE_BASE || end > 0x10000)
+            throw runtime_error(format("Device {} does not fit the device window at {}", device->name(), base));
+
+        for (const auto& m : mappings)
+            if (base < m.base + m.size && m.base < end)
+                throw runtime_error(format("Device {} at {} overlaps device {} at {}",
+                                           device->name(), base, m.device->name(), m.base));
+
+        mappings.push_back({ (uint16_t)base, device->size(), move(device) });
+        next_base = max(next_base, end);
+        return (uint16_t)base;
+    }
+
+    // Spec format: timer | random[:seed] | file:[input_loc][:output_loc] | lock, optionally followed
+    // by @address. The timer counts the given cycle counter.
+    uint16_t attach(const string& spec, const uint64_t& cycles)
+    {
+        string kind = spec;
+        optional<uint16_t> address;
+        if (auto at = spec.rfind('@'); at != string::npos)
+        {
+            kind = spec.substr(0, at);
+            address = (uint16_t)stoul(spec.substr(at + 1));
+        }
+
+        vector<string> args;
+        stringstream sstr{ kind };
+        for (string part; std::getline(sstr, part, ':');)
+            args.push_back(part);
+
+        if (args.size() == 1 && args[0] == "timer")
+            return attach(make_unique<TIMER_DEVICE>(cycles), address);
+        if (args.size() == 1 && args[0] == "lock")
+            return attach(make_unique<LOCK_DEVICE>(), address);
+        if (args.size() <= 2 && args[0] == "random")
+            return attach(make_unique<RANDOM_DEVICE>(args.size() == 2 ? (uint32_t)stoul(args[1]) : 1), address);
+        if (args.size() >= 1 && args.size() <= 3 && args[0] == "file")
+            return attach(make_unique<FILE_DEVICE>(args.size() >= 2 ? args[1] : "", args.size() == 3 ? args[2] : ""),
+                          address);
+
+        throw runtime_error(format("Invalid device: '{}'", spec));
+    }
+
+    MAPPING& find(uint16_t address)
+    {
+        for (auto& m : mappings)
+            if (address >= m.base && address - m.base < m.size)
+                return m;
+
+        DATA_MEMORY::invalid_address(address);
+    }
+
+    int16_t read(uint16_t address) override
+    {
+        auto& m = find(address);
+        return m.device->read(address - m.base);
+    }
+
+    void write(uint16_t address, int16_t value) override
+    {
+        auto& m = find(address);
+        m.device->write(address - m.base, value);
+    }
+};
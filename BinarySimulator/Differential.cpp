@@ -0,0 +1,334 @@
+#include <bitset>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+#include "Engines.h"
+
+using namespace std;
+
+// Lockstep differential checker: runs the reference iterator and another engine on the
+// same ROM and compares A, D, PC and the data words written at every basic-block
+// boundary. On the first mismatch both runs are replayed one instruction at a time
+// from the start of the diverging block to report the first instruction that differs.
+
+const size_t MAX_BLOCK_LENGTH = 256;
+
+struct STEP
+{
+    uint16_t pc;
+    uint16_t ins;
+    vector<uint16_t> writes;
+};
+
+struct OUTCOME
+{
+    uint64_t cycles{};
+    bool diverged{};
+};
+
+// Location and data words the instruction at PC is going to write
+static STEP decode_step(const Motherboard& mbd)
+{
+    STEP step{ mbd.regs.PC, 0, {} };
+    auto pc = mbd.regs.PC;
+    if (pc >= INSTRUCTION_COUNT)
+        return step;
+
+    uint16_t ins = mbd.im[pc];
+    while (ins == NOP && pc + 1 < INSTRUCTION_COUNT)
+        ins = mbd.im[++pc];
+    step.ins = ins;
+
+    if (get_instruction_type(ins) != InstructionType::C)
+        return step;
+
+    auto address = bit_cast<uint16_t>(mbd.regs.A);
+    uint8_t c = (ins & 07700) >> 6;
+    uint8_t a = (ins & 010000) >> 12;
+    if (mbd.isa == ISA::HACKX && a == 0 && c == HACKX_MOVE)
+    {
+        for (uint16_t i = 0; i <= (ins & 077); ++i)
+            step.writes.push_back(address + i);
+    }
+    else if (ins & 010)
+        step.writes.push_back(address);
+
+    return step;
+}
+
+// A block ends after any C-instruction with jump bits, i.e. wherever control may transfer
+static bool ends_block(const STEP& step)
+{
+    return get_instruction_type(step.ins) == InstructionType::C && (step.ins & 07) != 0;
+}
+
+static optional<string> run_guarded(const function<void()>& f)
+{
+    try
+    {
+        f();
+    }
+    catch (const std::exception& e)
+    {
+        string what = e.what();
+        while (!what.empty() && what.back() == '\n')
+            what.pop_back();
+        return what;
+    }
+    return nullopt;
+}
+
+static string describe(const Motherboard& mbd)
+{
+    return format("A={} D={} PC={}", mbd.regs.A, mbd.regs.D, mbd.regs.PC);
+}
+
+static bool word_equal(const Motherboard& x, const Motherboard& y, uint16_t address)
+{
+    return address >= DATA_COUNT || x.dm[address] == y.dm[address];
+}
+
+static bool same_state(const Motherboard& ref, const Motherboard& alt, const vector<uint16_t>& writes)
+{
+    if (ref.regs.A != alt.regs.A || ref.regs.D != alt.regs.D || ref.regs.PC != alt.regs.PC)
+        return false;
+
+    for (auto address : writes)
+        if (!word_equal(ref, alt, address))
+            return false;
+
+    return true;
+}
+
+static unique_ptr<Motherboard> make_motherboard(const vector<uint16_t>& rom, ISA isa)
+{
+    auto mbd = make_unique<Motherboard>();
+    mbd->isa = isa;
+    copy(rom.begin(), rom.end(), mbd->im.rom.begin());
+    return mbd;
+}
+
+// Replays the diverging block one instruction at a time and prints the minimal trace
+static void report_divergence(const vector<uint16_t>& rom, ISA isa, const ENGINE& engine, uint64_t block_start)
+{
+    auto ref = make_motherboard(rom, isa);
+    auto alt = make_motherboard(rom, isa);
+    auto run = engine.load(*alt);
+
+    run_guarded([&] { run_reference(*ref, block_start); });
+    run_guarded([&] { run(*alt, block_start); });
+
+    cerr << format("Divergence in the block starting at cycle {} (PC={}):\n", block_start, ref->regs.PC);
+    cerr << format("{:<10}{:<8}{:<20}{:<34}{}\n", "Cycle", "PC", "Instruction", "reference", engine.name);
+
+    for (uint64_t cycle = block_start; cycle < block_start + MAX_BLOCK_LENGTH; ++cycle)
+    {
+        auto step = decode_step(*ref);
+        auto ref_error = run_guarded([&] { ++ref->begin(); });
+        auto alt_error = run_guarded([&] { run(*alt, 1); });
+
+        cerr << format("{:<10}{:<8}{:<20}{:<34}{}\n", cycle, step.pc, bitset<16>(step.ins).to_string(),
+                       describe(*ref), describe(*alt));
+        if (ref_error || alt_error)
+            cerr << format("  reference error: '{}', {} error: '{}'\n", ref_error.value_or("none"),
+                           engine.name, alt_error.value_or("none"));
+
+        if (ref_error || alt_error || !same_state(*ref, *alt, step.writes))
+        {
+            for (auto address : step.writes)
+                if (!word_equal(*ref, *alt, address))
+                    cerr << format("  RAM[{}]: reference {} vs {} {}\n", address,
+                                   ref->dm[address], engine.name, alt->dm[address]);
+            return;
+        }
+    }
+}
+
+static OUTCOME check(const vector<uint16_t>& rom, ISA isa, const ENGINE& engine, uint64_t max_cycles)
+{
+    auto ref = make_motherboard(rom, isa);
+    auto alt = make_motherboard(rom, isa);
+    auto run = engine.load(*alt);
+
+    OUTCOME outcome{};
+    vector<uint16_t> writes;
+
+    while (outcome.cycles < max_cycles && ref->regs.PC != TERMINATION_PC_ADDRESS)
+    {
+        // Advance the reference to the end of the block
+        uint64_t length = 0;
+        optional<string> ref_error;
+        writes.clear();
+        while (length < MAX_BLOCK_LENGTH && outcome.cycles + length < max_cycles &&
+               ref->regs.PC != TERMINATION_PC_ADDRESS)
+        {
+            auto step = decode_step(*ref);
+            ref_error = run_guarded([&] { ++ref->begin(); });
+            if (ref_error)
+                break;
+
+            writes.insert(writes.end(), step.writes.begin(), step.writes.end());
+            ++length;
+            if (ends_block(step))
+                break;
+        }
+
+        // Advance the engine by the same number of instructions
+        uint64_t executed = 0;
+        auto alt_error = run_guarded([&] { executed = run(*alt, length); });
+        if (!alt_error && ref_error)
+            alt_error = run_guarded([&] { run(*alt, 1); });
+
+        if (executed != length || ref_error != alt_error || !same_state(*ref, *alt, writes))
+        {
+            outcome.diverged = true;
+            if (ref_error != alt_error)
+                cerr << format("Errors differ: reference '{}', {} '{}'\n", ref_error.value_or("none"),
+                               engine.name, alt_error.value_or("none"));
+            report_divergence(rom, isa, engine, outcome.cycles);
+            return outcome;
+        }
+
+        outcome.cycles += length;
+        if (ref_error)
+            break;
+    }
+
+    for (uint32_t address = 0; address < DATA_COUNT; ++address)
+        if (ref->dm[address] != alt->dm[address])
+        {
+            cerr << format("Final data memory differs at RAM[{}]: reference {} vs {} {}\n", address,
+                           ref->dm[address], engine.name, alt->dm[address]);
+            outcome.diverged = true;
+            break;
+        }
+
+    return outcome;
+}
+
+// Random but well-formed ROM: valid comp codes, A-instructions that mostly point at
+// valid data words or at instructions of the program, a few NOPs, and a halt at the end.
+static vector<uint16_t> random_rom(mt19937_64& rng, size_t length, ISA isa)
+{
+    static constexpr uint8_t COMP_A0[] = { 0b101010, 0b111111, 0b111010, 0b001100, 0b110000, 0b001101,
+                                           0b110001, 0b001111, 0b110011, 0b011111, 0b110111, 0b001110,
+                                           0b110010, 0b000010, 0b010011, 0b000111, 0b000000, 0b010101 };
+    static constexpr uint8_t COMP_A1[] = { 0b110000, 0b110001, 0b110011, 0b110111, 0b110010,
+                                           0b000010, 0b010011, 0b000111, 0b000000, 0b010101 };
+    static constexpr uint8_t HACKX_A0[] = { 0b000001, 0b000011, 0b000100, 0b000101, 0b000110, HACKX_MOVE };
+    static constexpr uint8_t HACKX_A1[] = { 0b000100, 0b000101, 0b000110 };
+
+    auto pick = [&](auto& list) { return list[rng() % size(list)]; };
+    auto chance = [&](int percent) { return (int)(rng() % 100) < percent; };
+
+    length = max<size_t>(length, 4);
+    vector<uint16_t> rom(length);
+    for (size_t i = 0; i + 2 < length; ++i)
+    {
+        if (chance(5))
+            rom[i] = NOP;
+        else if (chance(40))
+        {
+            if (chance(50))
+                rom[i] = rng() % 512;                   // pointers, temps, statics, stack
+            else if (chance(70))
+                rom[i] = rng() % length;                // jump target
+            else
+                rom[i] = rng() % DATA_COUNT;
+        }
+        else
+        {
+            uint16_t a = chance(40);
+            uint16_t c = (isa == ISA::HACKX && chance(15)) ? (a ? pick(HACKX_A1) : pick(HACKX_A0))
+                                                           : (a ? pick(COMP_A1) : pick(COMP_A0));
+            uint16_t d = rng() % 8;
+            uint16_t j = chance(25) ? rng() % 8 : 0;
+            rom[i] = 0b111 << 13 | a << 12 | c << 6 | d << 3 | j;
+        }
+    }
+
+    // A = -1; 0;JMP
+    rom[length - 2] = 0b1110'1110'1010'0000;
+    rom[length - 1] = 0b1110'1010'1000'0111;
+    return rom;
+}
+
+int main(int argc, char** argv)
+{
+    ISA isa = ISA::HACK;
+    string engine_name = ENGINES[1].name;
+    uint64_t max_cycles = 100'000'000;
+    uint64_t fuzz = 0;
+    uint64_t seed = random_device{}();
+    size_t length = 200;
+    vector<string> paths;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--isa=hackx")
+            isa = ISA::HACKX;
+        else if (arg == "--engine" && i + 1 < argc)
+            engine_name = argv[++i];
+        else if (arg == "--max-cycles" && i + 1 < argc)
+            max_cycles = stoull(argv[++i]);
+        else if (arg == "--fuzz" && i + 1 < argc)
+            fuzz = stoull(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = stoull(argv[++i]);
+        else if (arg == "--length" && i + 1 < argc)
+            length = min<size_t>(stoull(argv[++i]), INSTRUCTION_COUNT);
+        else
+            paths.push_back(arg);
+    }
+
+    const ENGINE* engine = nullptr;
+    for (auto& e : ENGINES)
+        if (engine_name == e.name)
+            engine = &e;
+
+    if (!engine || (paths.empty() && fuzz == 0))
+    {
+        cerr << "format: ./differential.out [--isa=hackx] [--engine name] [--max-cycles N] rom_file..." << endl;
+        cerr << "        ./differential.out [--isa=hackx] [--engine name] [--max-cycles N] --fuzz N [--seed S] [--length L]" << endl;
+        std::exit(-1);
+    }
+
+    for (auto& path : paths)
+    {
+        vector<uint16_t> rom;
+        load_binary_file(path, [&](size_t, uint16_t val) { rom.push_back(val); }, rom_image_flags(isa));
+        rom.resize(min<size_t>(rom.size(), INSTRUCTION_COUNT));
+
+        auto outcome = check(rom, isa, *engine, max_cycles);
+        cerr << format("{}: {} after {} cycles\n", path, outcome.diverged ? "DIVERGED" : "equivalent", outcome.cycles);
+        if (outcome.diverged)
+            return 1;
+    }
+
+    uint64_t total_cycles = 0;
+    for (uint64_t i = 0; i < fuzz; ++i)
+    {
+        mt19937_64 rng{ seed + i };
+        auto rom = random_rom(rng, length, isa);
+        auto outcome = check(rom, isa, *engine, max_cycles);
+        total_cycles += outcome.cycles;
+
+        if (outcome.diverged)
+        {
+            cerr << format("Fuzz program {} (seed {}) DIVERGED, ROM written to fuzz_failure.hack\n", i, seed + i);
+            ofstream out{ "fuzz_failure.hack" };
+            for (auto ins : rom)
+                out << bitset<16>(ins) << "\n";
+            return 1;
+        }
+    }
+
+    if (fuzz)
+        cerr << format("{} random programs (seeds {}..{}) equivalent, {} cycles compared\n",
+                       fuzz, seed, seed + fuzz - 1, total_cycles);
+    return 0;
+}
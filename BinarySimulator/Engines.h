@@ -0,0 +1,61 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include "Motherboard.h"
+#include "PagedMemory.h"
+#include "Predecoded.h"
+
+// Runs the motherboard until termination or max_cycles; returns the executed cycles.
+using RUNNER = function<uint64_t(Motherboard&, uint64_t max_cycles)>;
+
+struct ENGINE
+{
+    const char* name;
+    // Prepares the engine for the ROM and ISA of the given motherboard.
+    RUNNER (*load)(const Motherboard&);
+};
+
+// Every execution engine available to the tools, the reference one first.
+const ENGINE ENGINES[] = {
+    { "reference", [](const Motherboard&) -> RUNNER {
+        return run_reference<DATA_MEMORY, INSTRUCTION_MEMORY>;
+    } },
+    { "predecoded", [](const Motherboard& mbd) -> RUNNER {
+        auto rom = make_shared<PREDECODED_ROM>();
+        rom->decode(mbd.im, mbd.isa);
+        return [rom](Motherboard& m, uint64_t max_cycles) { return rom->run(m, max_cycles); };
+    } },
+    // The predecoded engine with every instruction probed by no-op callbacks
+    { "instrumented", [](const Motherboard& mbd) -> RUNNER {
+        auto tools = make_shared<INSTRUMENTATION>();
+        tools->on_instruction([](const Motherboard&, uint16_t) {});
+        tools->on_block([](const Motherboard&, uint16_t) {});
+        tools->on_read([](const Motherboard&, uint16_t, uint16_t) {});
+        tools->on_write([](const Motherboard&, uint16_t, uint16_t) {});
+        auto rom = make_shared<PREDECODED_ROM>();
+        rom->decode(mbd.im, mbd.isa, tools.get());
+        return [tools, rom](Motherboard& m, uint64_t max_cycles) { return rom->run(m, max_cycles); };
+    } },
+    // The reference iterator on paged memories, copied in and out around each run
+    { "paged", [](const Motherboard& mbd) -> RUNNER {
+        auto im = make_shared<const PAGED_INSTRUCTION_MEMORY>(mbd.im);
+        return [im](Motherboard& m, uint64_t max_cycles) {
+            auto paged = make_unique<PAGED_MOTHERBOARD>(m.regs, PAGED_DATA_MEMORY(m.dm), *im, m.isa);
+            auto sync = [&] {
+                m.regs = paged->regs;
+                paged->dm.copy_to(m.dm);
+            };
+            try
+            {
+                auto cycles = run_reference(*paged, max_cycles);
+                sync();
+                return cycles;
+            }
+            catch (...)
+            {
+                sync();
+                throw;
+            }
+        };
+    } },
+};
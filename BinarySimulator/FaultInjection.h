@@ -0,0 +1,265 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "Motherboard.h"
+#include "Predecoded.h"
+
+using namespace std;
+
+// Single bit-flip campaign. A golden run fixes the expected output and cycle count, then every
+// fault flips one bit of A, D, PC, a RAM word or a ROM word at some cycle of the golden run and
+// runs to completion. Output is the RAM words the golden run changed plus the screen. The
+// checkpoint is advanced once through the golden run and each fault forks from a copy taken at
+// its injection cycle, so the common prefix is never re-simulated.
+struct FAULT_INJECTOR
+{
+    enum class TARGET : uint8_t
+    {
+        A,
+        D,
+        PC,
+        RAM,
+        ROM
+    };
+
+    enum class OUTCOME : uint8_t
+    {
+        MASKED,
+        WRONG_OUTPUT,
+        CRASH,
+        HANG
+    };
+
+    static constexpr const char* TARGET_NAMES[] = { "A", "D", "PC", "RAM", "ROM" };
+    static constexpr const char* OUTCOME_NAMES[] = { "masked", "wrong output", "crash", "hang" };
+    static constexpr size_t TARGET_COUNT = size(TARGET_NAMES);
+    static constexpr size_t OUTCOME_COUNT = size(OUTCOME_NAMES);
+
+    // Upper bound for the golden run, which has to terminate on its own
+    static constexpr uint64_t GOLDEN_MAX_CYCLES = 1ull << 32;
+
+    struct FAULT
+    {
+        uint64_t cycle;
+        TARGET target;
+        uint16_t address;
+        uint8_t bit;
+        OUTCOME outcome = OUTCOME::MASKED;
+        uint64_t cycles = 0;
+    };
+
+    unique_ptr<Motherboard> initial;
+    unique_ptr<Motherboard> golden;
+    PREDECODED_ROM rom{};
+    uint64_t golden_cycles = 0;
+    uint64_t max_cycles = 0;
+    uint16_t rom_length = 0;
+    vector<uint16_t> output_words;
+    vector<FAULT> faults;
+
+    // A faulty run that exceeds budget_factor times the golden cycle count is a hang
+    FAULT_INJECTOR(const Motherboard& mbd, uint64_t budget_factor)
+        : initial(make_unique<Motherboard>(mbd)), golden(make_unique<Motherboard>(mbd))
+    {
+        rom.decode(mbd.im, mbd.isa);
+        golden_cycles = rom.run(*golden, GOLDEN_MAX_CYCLES);
+        if (golden->regs.PC != TERMINATION_PC_ADDRESS)
+            throw runtime_error(format("Golden run did not terminate within {} cycles", GOLDEN_MAX_CYCLES));
+
+        max_cycles = max(golden_cycles * budget_factor, golden_cycles + 1000);
+        for (uint16_t i = 0; i < RAM_SIZE; ++i)
+            if (golden->dm.ram[i] != initial->dm.ram[i])
+                output_words.push_back(i);
+        for (uint32_t pc = 0; pc < INSTRUCTION_COUNT; ++pc)
+            if (mbd.im[pc] != 0)
+                rom_length = (uint16_t)(pc + 1);
+    }
+
+    // Draws count faults, each target kind equally likely, sorted by injection cycle
+    void generate(size_t count, uint64_t seed)
+    {
+        if (golden_cycles == 0)
+            throw runtime_error("Golden run executes no instructions, nothing to inject into");
+
+        mt19937_64 rng{ seed };
+        uniform_int_distribution<uint64_t> cycle(0, golden_cycles - 1);
+        uniform_int_distribution<int> target(0, TARGET_COUNT - 1);
+        uniform_int_distribution<int> bit(0, 15);
+        uniform_int_distribution<int> ram(0, RAM_SIZE - 1);
+        uniform_int_distribution<int> rom_word(0, max<int>(rom_length, 1) - 1);
+
+        faults.clear();
+        faults.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            FAULT f{ cycle(rng), (TARGET)target(rng), 0, (uint8_t)bit(rng) };
+            if (f.target == TARGET::RAM)
+                f.address = (uint16_t)ram(rng);
+            else if (f.target == TARGET::ROM)
+                f.address = (uint16_t)rom_word(rng);
+            faults.push_back(f);
+        }
+
+        stable_sort(faults.begin(), faults.end(), [](const FAULT& l, const FAULT& r) { return l.cycle < r.cycle; });
+    }
+
+    // Runs every fault on thread_count workers while this thread advances the checkpoint
+    void run(unsigned thread_count)
+    {
+        struct TASK
+        {
+            shared_ptr<const Motherboard> checkpoint;
+            FAULT* fault;
+        };
+
+        mutex lock;
+        condition_variable changed;
+        deque<TASK> queue;
+        bool done = false;
+        // Bounds the snapshots kept alive by queued tasks
+        const size_t max_queued = (size_t)thread_count * 8;
+
+        vector<thread> workers;
+        for (unsigned t = 0; t < max(thread_count, 1u); ++t)
+            workers.emplace_back([&] {
+                while (true)
+                {
+                    TASK task;
+                    {
+                        unique_lock guard{ lock };
+                        changed.wait(guard, [&] { return done || !queue.empty(); });
+                        if (queue.empty())
+                            return;
+                        task = move(queue.front());
+                        queue.pop_front();
+                    }
+                    changed.notify_all();
+                    execute(*task.checkpoint, *task.fault);
+                }
+            });
+
+        auto checkpoint = make_unique<Motherboard>(*initial);
+        uint64_t cycle = 0;
+        for (size_t i = 0; i < faults.size();)
+        {
+            cycle += rom.run(*checkpoint, faults[i].cycle - cycle);
+            shared_ptr<const Motherboard> snapshot = make_shared<Motherboard>(*checkpoint);
+
+            for (; i < faults.size() && faults[i].cycle == cycle; ++i)
+            {
+                unique_lock guard{ lock };
+                changed.wait(guard, [&] { return queue.size() < max_queued; });
+                queue.push_back({ snapshot, &faults[i] });
+                changed.notify_all();
+            }
+        }
+
+        {
+            lock_guard guard{ lock };
+            done = true;
+        }
+        changed.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    void report(ostream& out) const
+    {
+        uint64_t counts[TARGET_COUNT][OUTCOME_COUNT]{};
+        uint64_t totals[OUTCOME_COUNT]{};
+        for (const auto& f : faults)
+        {
+            ++counts[(size_t)f.target][(size_t)f.outcome];
+            ++totals[(size_t)f.outcome];
+        }
+
+        out << format("Golden run: {} cycles, {} output words, hang budget {} cycles, {} faults\n\n",
+                      golden_cycles, output_words.size(), max_cycles, faults.size());
+        out << format("{:<8}", "Target");
+        for (auto name : OUTCOME_NAMES)
+            out << format("{:>14}", name);
+        out << "\n";
+        for (size_t t = 0; t < TARGET_COUNT; ++t)
+        {
+            out << format("{:<8}", TARGET_NAMES[t]);
+            for (size_t o = 0; o < OUTCOME_COUNT; ++o)
+                out << format("{:>14}", counts[t][o]);
+            out << "\n";
+        }
+        out << format("{:<8}", "Total");
+        for (size_t o = 0; o < OUTCOME_COUNT; ++o)
+            out << format("{:>14}", totals[o]);
+        out << "\n";
+    }
+
+    // One line per fault, in injection order
+    void write_runs(ostream& out) const
+    {
+        out << "cycle,target,address,bit,outcome,cycles\n";
+        for (const auto& f : faults)
+            out << format("{},{},{},{},{},{}\n", f.cycle, TARGET_NAMES[(size_t)f.target], f.address, f.bit,
+                          OUTCOME_NAMES[(size_t)f.outcome], f.cycles);
+    }
+
+private:
+    static void flip(Motherboard& mbd, const FAULT& f)
+    {
+        auto mask = (uint16_t)(1u << f.bit);
+        switch (f.target)
+        {
+        case TARGET::A:
+            mbd.regs.A = bit_cast<int16_t>((uint16_t)(bit_cast<uint16_t>(mbd.regs.A) ^ mask));
+            break;
+        case TARGET::D:
+            mbd.regs.D = bit_cast<int16_t>((uint16_t)(bit_cast<uint16_t>(mbd.regs.D) ^ mask));
+            break;
+        case TARGET::PC:
+            mbd.regs.PC ^= mask;
+            break;
+        case TARGET::RAM:
+            mbd.dm.ram[f.address] = bit_cast<int16_t>((uint16_t)(bit_cast<uint16_t>(mbd.dm.ram[f.address]) ^ mask));
+            break;
+        case TARGET::ROM:
+            mbd.im[f.address] ^= mask;
+            break;
+        }
+    }
+
+    bool same_output(const Motherboard& mbd) const
+    {
+        for (auto i : output_words)
+            if (mbd.dm.ram[i] != golden->dm.ram[i])
+                return false;
+        return mbd.dm.screen == golden->dm.screen;
+    }
+
+    void execute(const Motherboard& checkpoint, FAULT& f) const
+    {
+        auto mbd = make_unique<Motherboard>(checkpoint);
+        flip(*mbd, f);
+
+        try
+        {
+            // The predecoded ROM no longer matches a corrupted ROM word
+            uint64_t budget = max_cycles - f.cycle;
+            f.cycles = f.cycle + (f.target == TARGET::ROM ? run_reference(*mbd, budget) : rom.run(*mbd, budget));
+            if (mbd->regs.PC != TERMINATION_PC_ADDRESS)
+                f.outcome = OUTCOME::HANG;
+            else
+                f.outcome = same_output(*mbd) ? OUTCOME::MASKED : OUTCOME::WRONG_OUTPUT;
+        }
+        catch (const exception&)
+        {
+            f.outcome = OUTCOME::CRASH;
+        }
+    }
+};
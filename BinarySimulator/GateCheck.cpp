@@ -0,0 +1,342 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "GateLevel.h"
+
+using namespace std;
+using namespace gates;
+
+// Cross-verification of the gate-level model (GateLevel.h) against the behavioural model:
+// - alu: every Hack comp code on every operand pair against ALU_a_0 / ALU_a_1, including zr/ng
+// - jump: every jump field on every ALU output against should_jump
+// - cpu: random programs run in lockstep, 64 per batch, against Motherboard::iterator,
+//   comparing A, D, PC and every write after each instruction
+
+struct COMP
+{
+    uint8_t a;
+    uint8_t c;
+};
+
+constexpr COMP COMPS[] = {
+    { 0, 0b101010 }, { 0, 0b111111 }, { 0, 0b111010 }, { 0, 0b001100 }, { 0, 0b110000 }, { 0, 0b001101 },
+    { 0, 0b110001 }, { 0, 0b001111 }, { 0, 0b110011 }, { 0, 0b011111 }, { 0, 0b110111 }, { 0, 0b001110 },
+    { 0, 0b110010 }, { 0, 0b000010 }, { 0, 0b010011 }, { 0, 0b000111 }, { 0, 0b000000 }, { 0, 0b010101 },
+    { 1, 0b110000 }, { 1, 0b110001 }, { 1, 0b110011 }, { 1, 0b110111 }, { 1, 0b110010 },
+    { 1, 0b000010 }, { 1, 0b010011 }, { 1, 0b000111 }, { 1, 0b000000 }, { 1, 0b010101 },
+};
+constexpr size_t COMP_COUNT = size(COMPS);
+
+// Bit k of vector i is bit k of i, for the low 6 bits of an operand
+constexpr LANES LANE_BITS[] = { 0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+                                0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull };
+
+static_assert(from_bus(to_bus([] {
+                  array<uint16_t, 64> words{};
+                  for (int i = 0; i < 64; ++i)
+                      words[i] = (uint16_t)(i * 1031 + 7);
+                  return words;
+              }()))[63] == (uint16_t)(63 * 1031 + 7));
+static_assert(to_bus([] {
+                  array<uint16_t, 64> words{};
+                  for (int i = 0; i < 64; ++i)
+                      words[i] = (uint16_t)i;
+                  return words;
+              }())[5] == LANE_BITS[5]);
+
+// The M operand of ALU_a_1
+struct M_WORD
+{
+    int16_t M;
+    constexpr int16_t read(uint16_t) const { return M; }
+};
+
+struct MISMATCH
+{
+    string what;
+};
+
+struct ALU_CHECK
+{
+    int operand_bits;
+    atomic<uint32_t> next_y{ 0 };
+    atomic<uint64_t> vectors{ 0 };
+    mutex lock;
+    optional<MISMATCH> mismatch;
+
+    // Operand v of the checked set: the low operand_bits bits, sign-extended
+    int16_t operand(uint32_t v) const
+    {
+        auto shift = 16 - operand_bits;
+        return (int16_t)((int16_t)(v << shift) >> shift);
+    }
+
+    template <size_t I>
+    void check_comp(int16_t y)
+    {
+        constexpr auto comp = COMPS[I];
+        auto c = [](int bit) { return broadcast((comp.c >> bit) & 1); };
+
+        BUS x_bus{}, y_bus{};
+        for (int k = 0; k < 16; ++k)
+            y_bus[k] = broadcast((y >> k) & 1);
+
+        array<uint16_t, 64> golden;
+        for (uint32_t base = 0; base < (1u << operand_bits); base += 64)
+        {
+            // Vector i checks x = operand(base + i); its bits above 5 are the same for all i
+            for (int k = 0; k < 16; ++k)
+                x_bus[k] = k < 6 ? LANE_BITS[k] : broadcast((operand(base) >> k) & 1);
+
+            auto gate = ALU(x_bus, y_bus, c(5), c(4), c(3), c(2), c(1), c(0));
+
+            LANES zr = 0, ng = 0;
+            for (int i = 0; i < 64; ++i)
+            {
+                REGISTERS regs{ operand(base + i), y, 0 };
+                M_WORD memory{ y };
+                auto out = comp.a == 0 ? ALU_a_0(regs, comp.c) : ALU_a_1(regs, memory, comp.c);
+                golden[i] = bit_cast<uint16_t>(out);
+                zr |= (LANES)(out == 0) << i;
+                ng |= (LANES)(out < 0) << i;
+            }
+
+            if (from_bus(gate.out) != golden || gate.zr != zr || gate.ng != ng)
+            {
+                auto words = from_bus(gate.out);
+                for (int i = 0; i < 64; ++i)
+                    if (words[i] != golden[i] || ((gate.zr ^ zr) >> i & 1) || ((gate.ng ^ ng) >> i & 1))
+                    {
+                        lock_guard guard{ lock };
+                        mismatch = MISMATCH{ format("comp a={} c={:06b}, x={} y={}: gates {} (zr={} ng={}), model {}",
+                                                    comp.a, comp.c, operand(base + i), y, bit_cast<int16_t>(words[i]),
+                                                    gate.zr >> i & 1, gate.ng >> i & 1, bit_cast<int16_t>(golden[i])) };
+                        return;
+                    }
+            }
+        }
+    }
+
+    template <size_t... I>
+    void check_all(int16_t y, index_sequence<I...>)
+    {
+        (check_comp<I>(y), ...);
+    }
+
+    void worker()
+    {
+        for (uint32_t v; (v = next_y++) < (1u << operand_bits);)
+        {
+            check_all(operand(v), make_index_sequence<COMP_COUNT>{});
+            vectors += (uint64_t)COMP_COUNT << operand_bits;
+
+            lock_guard guard{ lock };
+            if (mismatch)
+                return;
+        }
+    }
+};
+
+static optional<MISMATCH> check_alu(int operand_bits, unsigned thread_count, uint64_t& vectors)
+{
+    ALU_CHECK check{ operand_bits };
+    vector<thread> workers;
+    for (unsigned t = 0; t < thread_count; ++t)
+        workers.emplace_back([&] { check.worker(); });
+    for (auto& worker : workers)
+        worker.join();
+
+    vectors = check.vectors;
+    return check.mismatch;
+}
+
+static optional<MISMATCH> check_jump(uint64_t& vectors)
+{
+    for (uint8_t j = 0; j < 8; ++j)
+        for (uint32_t base = 0; base < 0x10000; base += 64)
+        {
+            array<uint16_t, 64> words;
+            for (int i = 0; i < 64; ++i)
+                words[i] = (uint16_t)(base + i);
+            auto bus = to_bus(words);
+            auto jump = Jump(broadcast(j & 4), broadcast(j & 2), broadcast(j & 1), Not(Or16Way(bus)), bus[15]);
+
+            for (int i = 0; i < 64; ++i)
+                if ((bool)(jump >> i & 1) != should_jump(j, bit_cast<int16_t>(words[i])))
+                    return MISMATCH{ format("j={:03b}, ALU output {}: gates {}, model {}", j,
+                                            bit_cast<int16_t>(words[i]), jump >> i & 1,
+                                            should_jump(j, bit_cast<int16_t>(words[i]))) };
+            vectors += 64;
+        }
+    return nullopt;
+}
+
+// Random Hack program without NOPs: valid comp codes, A-instructions that mostly point at
+// data words or instructions of the program, and a halt at the end
+static vector<uint16_t> random_program(mt19937_64& rng, size_t length)
+{
+    auto chance = [&](int percent) { return (int)(rng() % 100) < percent; };
+
+    vector<uint16_t> rom(length);
+    for (size_t i = 0; i + 2 < length; ++i)
+    {
+        if (chance(40))
+            rom[i] = (uint16_t)(chance(60) ? rng() % 512 : chance(70) ? rng() % length : rng() % DATA_COUNT);
+        else
+        {
+            auto comp = COMPS[rng() % COMP_COUNT];
+            uint16_t j = chance(25) ? rng() % 8 : 0;
+            rom[i] = (uint16_t)(0b111 << 13 | comp.a << 12 | comp.c << 6 | (rng() % 8) << 3 | j);
+        }
+    }
+
+    // A = -1; 0;JMP
+    rom[length - 2] = 0b1110'1110'1010'0000;
+    rom[length - 1] = 0b1110'1010'1000'0111;
+    return rom;
+}
+
+// 64 programs, one per vector; a vector stops being compared when its program terminates or
+// the model raises an error (invalid address), which the gates have no notion of
+static optional<MISMATCH> check_cpu_batch(mt19937_64& rng, size_t length, uint64_t max_cycles, uint64_t& vectors)
+{
+    vector<unique_ptr<Motherboard>> boards;
+    for (int i = 0; i < 64; ++i)
+    {
+        boards.push_back(make_unique<Motherboard>());
+        auto rom = random_program(rng, length);
+        copy(rom.begin(), rom.end(), boards.back()->im.rom.begin());
+    }
+
+    CPU cpu{};
+    LANES live = ALL;
+    for (uint64_t cycle = 0; cycle < max_cycles && live; ++cycle)
+    {
+        auto pcs = from_bus(cpu.pc.out);
+        auto a = from_bus(cpu.a.out);
+        array<uint16_t, 64> instructions{}, in_m{};
+        for (int i = 0; i < 64; ++i)
+        {
+            if (!(live >> i & 1))
+                continue;
+            auto& mbd = *boards[i];
+            // Equal to the model's PC, which raises an error there
+            if (pcs[i] >= INSTRUCTION_COUNT)
+            {
+                live &= ~(1ull << i);
+                continue;
+            }
+            instructions[i] = mbd.im[pcs[i]];
+            if (auto word = mbd.dm.word(a[i]))
+                in_m[i] = bit_cast<uint16_t>(*word);
+        }
+
+        auto outputs = cpu.step(to_bus(instructions), to_bus(in_m), 0);
+        auto out_m = from_bus(outputs.out_m);
+        auto address_m = from_bus(outputs.address_m);
+        auto next_a = from_bus(cpu.a.out), next_d = from_bus(cpu.d.out), next_pc = from_bus(cpu.pc.out);
+
+        for (int i = 0; i < 64; ++i)
+        {
+            if (!(live >> i & 1))
+                continue;
+            auto& mbd = *boards[i];
+            try
+            {
+                ++mbd.begin();
+            }
+            catch (const exception&)
+            {
+                live &= ~(1ull << i);
+                continue;
+            }
+
+            bool write_m = outputs.write_m >> i & 1;
+            if (bit_cast<uint16_t>(mbd.regs.A) != next_a[i] || bit_cast<uint16_t>(mbd.regs.D) != next_d[i] ||
+                mbd.regs.PC != next_pc[i] || (write_m && mbd.dm[address_m[i]] != bit_cast<int16_t>(out_m[i])))
+                return MISMATCH{ format("vector {}, cycle {}, instruction {:016b} at PC {}: gates A={} D={} PC={}{}, "
+                                        "model A={} D={} PC={}", i, cycle, instructions[i], pcs[i],
+                                        bit_cast<int16_t>(next_a[i]), bit_cast<int16_t>(next_d[i]), next_pc[i],
+                                        write_m ? format(" RAM[{}]={}", address_m[i], bit_cast<int16_t>(out_m[i])) : "",
+                                        mbd.regs.A, mbd.regs.D, mbd.regs.PC) };
+
+            ++vectors;
+            if (mbd.regs.PC == TERMINATION_PC_ADDRESS)
+                live &= ~(1ull << i);
+        }
+    }
+    return nullopt;
+}
+
+int main(int argc, char** argv)
+{
+    int operand_bits = 16;
+    unsigned threads = max(thread::hardware_concurrency(), 1u);
+    uint64_t programs = 256;
+    uint64_t max_cycles = 10000;
+    uint64_t seed = random_device{}();
+    size_t length = 200;
+    vector<string> checks;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--operand-bits" && i + 1 < argc)
+            operand_bits = clamp(stoi(argv[++i]), 7, 16);
+        else if (arg == "--threads" && i + 1 < argc)
+            threads = max(stoi(argv[++i]), 1);
+        else if (arg == "--programs" && i + 1 < argc)
+            programs = stoull(argv[++i]);
+        else if (arg == "--max-cycles" && i + 1 < argc)
+            max_cycles = stoull(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = stoull(argv[++i]);
+        else if (arg == "--length" && i + 1 < argc)
+            length = clamp<size_t>(stoull(argv[++i]), 4, INSTRUCTION_COUNT);
+        else if (arg == "alu" || arg == "jump" || arg == "cpu")
+            checks.push_back(arg);
+        else
+        {
+            cerr << "format: ./gatecheck.out [--operand-bits 7-16] [--threads N] [--programs N] [--max-cycles N] [--seed S] [--length L] [alu] [jump] [cpu]" << endl;
+            std::exit(-1);
+        }
+    }
+    if (checks.empty())
+        checks = { "alu", "jump", "cpu" };
+
+    for (const auto& name : checks)
+    {
+        auto start = chrono::steady_clock::now();
+        uint64_t vectors = 0;
+        optional<MISMATCH> mismatch;
+        if (name == "alu")
+            mismatch = check_alu(operand_bits, threads, vectors);
+        else if (name == "jump")
+            mismatch = check_jump(vectors);
+        else
+        {
+            mt19937_64 rng{ seed };
+            for (uint64_t batch = 0; batch * 64 < programs && !mismatch; ++batch)
+                mismatch = check_cpu_batch(rng, length, max_cycles, vectors);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        if (mismatch)
+        {
+            cerr << format("{}: MISMATCH {}\n", name, mismatch->what);
+            return 1;
+        }
+        cerr << format("{}: {} vectors equivalent in {:.2f} s\n", name, vectors, seconds);
+    }
+    if (find(checks.begin(), checks.end(), "cpu") != checks.end())
+        cerr << format("cpu programs: seed {}\n", seed);
+    return 0;
+}
@@ -0,0 +1,223 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "Motherboard.h"
+
+using namespace std;
+
+// Gate-level model of the Hack CPU, built from the chips of the HDL design (Not, And, Or,
+// Xor, Mux, FullAdder, Add16, Inc16, ALU, Register, PC, CPU) for cross-verification against
+// the behavioural model in Motherboard.h. Signals are bit-sliced: a LANES word holds one
+// signal for 64 independent test vectors (bit i belongs to vector i) and a BUS holds the 16
+// wires of a word, so every gate evaluation advances 64 vectors at once. Only the Hack ISA
+// is modelled; HackX comp codes have no gates.
+namespace gates
+{
+    using LANES = uint64_t;
+    using BUS = array<LANES, 16>;
+
+    constexpr LANES ALL = ~LANES{ 0 };
+
+    constexpr LANES Not(LANES in) { return ~in; }
+    constexpr LANES And(LANES a, LANES b) { return a & b; }
+    constexpr LANES Or(LANES a, LANES b) { return a | b; }
+    constexpr LANES Xor(LANES a, LANES b) { return a ^ b; }
+    constexpr LANES Mux(LANES a, LANES b, LANES sel) { return Or(And(a, Not(sel)), And(b, sel)); }
+
+    // The same control for every vector
+    constexpr LANES broadcast(bool bit) { return bit ? ALL : 0; }
+
+    constexpr BUS Not16(const BUS& in)
+    {
+        BUS out{};
+        for (int i = 0; i < 16; ++i)
+            out[i] = Not(in[i]);
+        return out;
+    }
+
+    constexpr BUS And16(const BUS& a, const BUS& b)
+    {
+        BUS out{};
+        for (int i = 0; i < 16; ++i)
+            out[i] = And(a[i], b[i]);
+        return out;
+    }
+
+    constexpr BUS Mux16(const BUS& a, const BUS& b, LANES sel)
+    {
+        BUS out{};
+        for (int i = 0; i < 16; ++i)
+            out[i] = Mux(a[i], b[i], sel);
+        return out;
+    }
+
+    constexpr LANES Or16Way(const BUS& in)
+    {
+        LANES out = 0;
+        for (int i = 0; i < 16; ++i)
+            out = Or(out, in[i]);
+        return out;
+    }
+
+    struct SUM
+    {
+        LANES sum;
+        LANES carry;
+    };
+
+    constexpr SUM FullAdder(LANES a, LANES b, LANES c)
+    {
+        auto half = Xor(a, b);
+        return { Xor(half, c), Or(And(a, b), And(half, c)) };
+    }
+
+    // Ripple-carry, the carry out of bit 15 is dropped
+    constexpr BUS Add16(const BUS& a, const BUS& b)
+    {
+        BUS out{};
+        LANES carry = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            auto s = FullAdder(a[i], b[i], carry);
+            out[i] = s.sum;
+            carry = s.carry;
+        }
+        return out;
+    }
+
+    constexpr BUS Inc16(const BUS& in)
+    {
+        BUS one{};
+        one[0] = ALL;
+        return Add16(in, one);
+    }
+
+    struct ALU_OUT
+    {
+        BUS out;
+        LANES zr;
+        LANES ng;
+    };
+
+    constexpr ALU_OUT ALU(const BUS& x, const BUS& y, LANES zx, LANES nx, LANES zy, LANES ny, LANES f, LANES no)
+    {
+        BUS zero{};
+        auto x1 = Mux16(x, zero, zx);
+        auto x2 = Mux16(x1, Not16(x1), nx);
+        auto y1 = Mux16(y, zero, zy);
+        auto y2 = Mux16(y1, Not16(y1), ny);
+        auto f_out = Mux16(And16(x2, y2), Add16(x2, y2), f);
+        auto out = Mux16(f_out, Not16(f_out), no);
+        return { out, Not(Or16Way(out)), out[15] };
+    }
+
+    // Jump condition of a C-instruction from its j bits and the ALU status
+    constexpr LANES Jump(LANES j2, LANES j1, LANES j0, LANES zr, LANES ng)
+    {
+        auto positive = And(Not(ng), Not(zr));
+        return Or(Or(And(j2, ng), And(j1, zr)), And(j0, positive));
+    }
+
+    // Clocked 16-bit register: clock() latches in where load is set
+    struct Register
+    {
+        BUS out{};
+
+        constexpr void clock(const BUS& in, LANES load) { out = Mux16(out, in, load); }
+    };
+
+    // Program counter: reset has priority over load, load over inc
+    struct PC
+    {
+        BUS out{};
+
+        constexpr void clock(const BUS& in, LANES load, LANES inc, LANES reset)
+        {
+            BUS zero{};
+            auto next = Mux16(out, Inc16(out), inc);
+            next = Mux16(next, in, load);
+            out = Mux16(next, zero, reset);
+        }
+    };
+
+    // The Hack CPU chip. step() evaluates the outputs from the current state and the inputs,
+    // then clocks the registers: outM, writeM and addressM belong to the executed instruction,
+    // pc to the next one.
+    struct CPU
+    {
+        Register a{};
+        Register d{};
+        PC pc{};
+
+        struct OUTPUTS
+        {
+            BUS out_m;
+            LANES write_m;
+            BUS address_m;
+        };
+
+        constexpr OUTPUTS step(const BUS& instruction, const BUS& in_m, LANES reset)
+        {
+            auto is_c = instruction[15];
+            auto y = Mux16(a.out, in_m, And(is_c, instruction[12]));
+            auto alu = ALU(d.out, y, instruction[11], instruction[10], instruction[9], instruction[8],
+                           instruction[7], instruction[6]);
+
+            auto jump = And(is_c, Jump(instruction[2], instruction[1], instruction[0], alu.zr, alu.ng));
+
+            OUTPUTS outputs{ alu.out, And(is_c, instruction[3]), a.out };
+            pc.clock(a.out, jump, ALL, reset);
+            d.clock(alu.out, And(is_c, instruction[4]));
+            a.clock(Mux16(instruction, alu.out, is_c), Or(Not(is_c), instruction[5]));
+            return outputs;
+        }
+    };
+
+    // 8x8 bit matrix in a word, byte r = row r: returns its transpose
+    constexpr uint64_t transpose8(uint64_t x)
+    {
+        uint64_t t;
+        t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+        x ^= t ^ (t << 7);
+        t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+        x ^= t ^ (t << 14);
+        t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+        x ^= t ^ (t << 28);
+        return x;
+    }
+
+    // Bit-slices 64 words, word i to vector i
+    constexpr BUS to_bus(const array<uint16_t, 64>& words)
+    {
+        BUS bus{};
+        for (int half = 0; half < 2; ++half)
+            for (int group = 0; group < 8; ++group)
+            {
+                // Byte r: the half-th byte of word 8 * group + r
+                uint64_t block = 0;
+                for (int r = 0; r < 8; ++r)
+                    block |= (uint64_t)((words[8 * group + r] >> (8 * half)) & 0xFF) << (8 * r);
+                block = transpose8(block);
+                for (int bit = 0; bit < 8; ++bit)
+                    bus[8 * half + bit] |= ((block >> (8 * bit)) & 0xFF) << (8 * group);
+            }
+        return bus;
+    }
+
+    constexpr array<uint16_t, 64> from_bus(const BUS& bus)
+    {
+        array<uint16_t, 64> words{};
+        for (int half = 0; half < 2; ++half)
+            for (int group = 0; group < 8; ++group)
+            {
+                // Byte r: lanes 8 * group onwards of wire 8 * half + r
+                uint64_t block = 0;
+                for (int r = 0; r < 8; ++r)
+                    block |= ((bus[8 * half + r] >> (8 * group)) & 0xFF) << (8 * r);
+                block = transpose8(block);
+                for (int lane = 0; lane < 8; ++lane)
+                    words[8 * group + lane] |= (uint16_t)(((block >> (8 * lane)) & 0xFF) << (8 * half));
+            }
+        return words;
+    }
+}
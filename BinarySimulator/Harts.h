@@ -0,0 +1,262 @@
+#pragma once
+#include <algorithm>
+#include <barrier>
+#include <bitset>
+#include <exception>
+#include <format>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "Motherboard.h"
+
+using namespace std;
+
+// One CPU of a multi-hart machine: its own registers and ROM, sharing the data memory.
+struct HART
+{
+    REGISTERS regs{};
+    unique_ptr<INSTRUCTION_MEMORY> im = make_unique<INSTRUCTION_MEMORY>();
+    ISA isa = ISA::HACK;
+    uint64_t cycles = 0;
+
+    bool finished() const { return regs.PC == TERMINATION_PC_ADDRESS; }
+};
+
+// Private view of the shared data memory for one hart during a parallel round. Pages are
+// copied on first write, and the pages read and written are recorded so that the round
+// can be checked against the sequential schedule. Any access outside RAM, screen and
+// keyboard (devices, invalid addresses) abandons the attempt.
+struct OVERLAY_MEMORY
+{
+    static constexpr uint16_t PAGE_SIZE = 256;
+    static constexpr uint16_t PAGE_COUNT = (DATA_COUNT + PAGE_SIZE - 1) / PAGE_SIZE;
+    using PAGE = array<int16_t, PAGE_SIZE>;
+    using PAGE_SET = bitset<PAGE_COUNT>;
+
+    struct CONFLICT {};
+
+    const DATA_MEMORY* base = nullptr;
+    array<unique_ptr<PAGE>, PAGE_COUNT> pages{};    // reused across rounds
+    PAGE_SET read_set;
+    PAGE_SET write_set;
+
+    void reset(const DATA_MEMORY& dm)
+    {
+        base = &dm;
+        read_set.reset();
+        write_set.reset();
+    }
+
+    const int16_t* word(uint16_t address) const
+    {
+        if (address >= DATA_COUNT)
+            return nullptr;
+        if (write_set[address / PAGE_SIZE])
+            return &(*pages[address / PAGE_SIZE])[address % PAGE_SIZE];
+        return base->word(address);
+    }
+
+    int16_t read(uint16_t address)
+    {
+        if (address >= DATA_COUNT)
+            throw CONFLICT{};
+
+        read_set.set(address / PAGE_SIZE);
+        return *word(address);
+    }
+
+    void write(uint16_t address, int16_t value)
+    {
+        if (address >= DATA_COUNT)
+            throw CONFLICT{};
+
+        auto p = address / PAGE_SIZE;
+        if (!write_set[p])
+        {
+            if (!pages[p])
+                pages[p] = make_unique<PAGE>();
+            for (uint16_t i = 0; i < PAGE_SIZE && p * PAGE_SIZE + i < DATA_COUNT; ++i)
+                (*pages[p])[i] = *base->word(p * PAGE_SIZE + i);
+            write_set.set(p);
+        }
+        (*pages[p])[address % PAGE_SIZE] = value;
+    }
+
+    void merge_into(DATA_MEMORY& dm) const
+    {
+        for (uint16_t p = 0; p < PAGE_COUNT; ++p)
+            if (write_set[p])
+                for (uint16_t i = 0; i < PAGE_SIZE && p * PAGE_SIZE + i < DATA_COUNT; ++i)
+                    dm[p * PAGE_SIZE + i] = (*pages[p])[i];
+    }
+};
+
+using OVERLAY_MOTHERBOARD = BASIC_MOTHERBOARD<OVERLAY_MEMORY, INSTRUCTION_MEMORY>;
+
+// K harts on one shared data memory. The schedule is defined sequentially: in every round
+// each unfinished hart, in index order, runs up to quantum instructions. A round may instead
+// run all harts at once on worker threads, each against its own overlay. The parallel round
+// is kept only when no hart wrote a page that a later hart read or wrote, which makes it
+// identical to the sequential round; otherwise it is discarded and the round re-runs
+// sequentially. Results and cycle counts therefore never depend on the host scheduling.
+class MULTI_HART
+{
+    struct ATTEMPT
+    {
+        OVERLAY_MEMORY overlay{};
+        REGISTERS regs{};
+        uint64_t cycles = 0;
+        bool failed = false;
+    };
+
+    vector<ATTEMPT> attempts;
+    vector<jthread> workers;
+    unique_ptr<barrier<>> sync;
+    bool stopping = false;
+    uint64_t backoff = 0;           // rounds to run sequentially before trying parallel again
+    uint64_t next_attempt = 0;
+
+public:
+    static constexpr uint64_t MAX_BACKOFF = 64;
+
+    DATA_MEMORY dm{};
+    vector<HART> harts;
+    uint64_t quantum;
+    uint64_t executed = 0;          // instructions of all harts before the current quantum
+    uint64_t rounds = 0;
+    uint64_t parallel_rounds = 0;
+
+    MULTI_HART(size_t hart_count, uint64_t quantum, unsigned thread_count)
+        : attempts(hart_count), harts(hart_count), quantum(max<uint64_t>(quantum, 1))
+    {
+        if (hart_count < 2 || thread_count < 2)
+            return;
+
+        auto worker_count = min<size_t>(thread_count, hart_count);
+        sync = make_unique<barrier<>>(worker_count + 1);
+        for (size_t w = 0; w < worker_count; ++w)
+            workers.emplace_back([this, w, worker_count] {
+                while (true)
+                {
+                    sync->arrive_and_wait();
+                    if (stopping)
+                        return;
+                    for (size_t h = w; h < harts.size(); h += worker_count)
+                        attempt(h);
+                    sync->arrive_and_wait();
+                }
+            });
+    }
+
+    ~MULTI_HART()
+    {
+        if (sync)
+        {
+            stopping = true;
+            sync->arrive_and_wait();
+            workers.clear();
+        }
+    }
+
+    MULTI_HART(const MULTI_HART&) = delete;
+    MULTI_HART& operator=(const MULTI_HART&) = delete;
+
+    bool finished() const
+    {
+        return all_of(harts.begin(), harts.end(), [](const HART& h) { return h.finished(); });
+    }
+
+    // Runs rounds until every hart has terminated or max_rounds rounds have run
+    void run(uint64_t max_rounds = UINT64_MAX)
+    {
+        for (uint64_t r = 0; r < max_rounds && !finished(); ++r)
+            round();
+    }
+
+    void round()
+    {
+        ++rounds;
+        if (!workers.empty() && rounds >= next_attempt)
+        {
+            if (run_parallel())
+            {
+                ++parallel_rounds;
+                backoff = 0;
+                return;
+            }
+            backoff = clamp<uint64_t>(backoff * 2, 1, MAX_BACKOFF);
+            next_attempt = rounds + backoff;
+        }
+
+        for (size_t h = 0; h < harts.size(); ++h)
+        {
+            auto& hart = harts[h];
+            if (hart.finished())
+                continue;
+
+            Motherboard::iterator it{ dm, *hart.im, hart.regs, hart.isa };
+            uint64_t n = 0;
+            try
+            {
+                for (; n < quantum && it != Motherboard::end(); ++it)
+                    ++n;
+            }
+            catch (const exception& e)
+            {
+                hart.cycles += n;
+                throw runtime_error(format("Hart {}: {}", h, e.what()));
+            }
+            hart.cycles += n;
+            executed += n;
+        }
+    }
+
+private:
+    void attempt(size_t h)
+    {
+        auto& hart = harts[h];
+        auto& a = attempts[h];
+        a.overlay.reset(dm);
+        a.regs = hart.regs;
+        a.cycles = 0;
+        a.failed = false;
+        if (hart.finished())
+            return;
+
+        OVERLAY_MOTHERBOARD::iterator it{ a.overlay, *hart.im, a.regs, hart.isa };
+        try
+        {
+            for (; a.cycles < quantum && it != OVERLAY_MOTHERBOARD::end(); ++it)
+                ++a.cycles;
+        }
+        catch (...)
+        {
+            // Device accesses and errors are settled by the sequential round
+            a.failed = true;
+        }
+    }
+
+    bool run_parallel()
+    {
+        sync->arrive_and_wait();
+        sync->arrive_and_wait();
+
+        OVERLAY_MEMORY::PAGE_SET earlier_writes;
+        for (auto& a : attempts)
+        {
+            if (a.failed || (earlier_writes & (a.overlay.read_set | a.overlay.write_set)).any())
+                return false;
+            earlier_writes |= a.overlay.write_set;
+        }
+
+        for (size_t h = 0; h < harts.size(); ++h)
+        {
+            attempts[h].overlay.merge_into(dm);
+            harts[h].regs = attempts[h].regs;
+            harts[h].cycles += attempts[h].cycles;
+            executed += attempts[h].cycles;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,171 @@
+#pragma once
+#include <functional>
+#include <vector>
+#include "Motherboard.h"
+
+using namespace std;
+
+// Dynamic instrumentation for the predecoded engine. Analyses register callbacks on events,
+// each limited to a range of ROM addresses (instruction and block events) or data addresses
+// (memory events). When the ROM is decoded, only the instructions that can raise a
+// registered event are replaced by a probe entry, which runs the callbacks around the
+// reference iterator; every other instruction keeps its fast-path entry.
+//
+// - instruction: before the instruction at pc executes
+// - block: at the first instruction of a basic block, i.e. the start of the run and every
+//   instruction following one with jump bits, taken or not
+// - read: before the instruction reads address; write: after it wrote address
+struct ADDRESS_RANGE
+{
+    uint32_t from = 0;
+    uint32_t to = 0x10000;      // exclusive
+
+    constexpr bool contains(uint16_t address) const { return address >= from && address < to; }
+};
+
+struct INSTRUMENTATION
+{
+    using RANGE = ADDRESS_RANGE;
+
+    using PC_CALLBACK = function<void(const Motherboard&, uint16_t pc)>;
+    using MEMORY_CALLBACK = function<void(const Motherboard&, uint16_t pc, uint16_t address)>;
+
+    template <class CALLBACK>
+    struct PROBE
+    {
+        RANGE range;
+        CALLBACK callback;
+    };
+
+    vector<PROBE<PC_CALLBACK>> instruction_probes;
+    vector<PROBE<PC_CALLBACK>> block_probes;
+    vector<PROBE<MEMORY_CALLBACK>> read_probes;
+    vector<PROBE<MEMORY_CALLBACK>> write_probes;
+    bool started = false;
+
+    void on_instruction(PC_CALLBACK callback, RANGE pcs = {}) { instruction_probes.push_back({ pcs, move(callback) }); }
+    void on_block(PC_CALLBACK callback, RANGE pcs = {}) { block_probes.push_back({ pcs, move(callback) }); }
+    void on_read(MEMORY_CALLBACK callback, RANGE addresses = {}) { read_probes.push_back({ addresses, move(callback) }); }
+    void on_write(MEMORY_CALLBACK callback, RANGE addresses = {}) { write_probes.push_back({ addresses, move(callback) }); }
+
+    // Instruction events on [from, to) only, e.g. the entry of a function
+    void on_pc_range(uint16_t from, uint32_t to, PC_CALLBACK callback) { on_instruction(move(callback), { from, to }); }
+
+    bool empty() const
+    {
+        return instruction_probes.empty() && block_probes.empty() && read_probes.empty() && write_probes.empty();
+    }
+
+    struct ACCESS
+    {
+        uint16_t address = 0;
+        uint16_t count = 0;
+    };
+
+    // Data words the instruction will read and write, given the registers before it executes
+    static void accesses(uint16_t ins, const REGISTERS& regs, ISA isa, ACCESS& read, ACCESS& write)
+    {
+        if (get_instruction_type(ins) != InstructionType::C)
+            return;
+
+        uint8_t d = (ins & 070) >> 3;
+        uint8_t c = (ins & 07700) >> 6;
+        uint8_t a = (ins & 010000) >> 12;
+        auto address = bit_cast<uint16_t>(regs.A);
+        if (isa == ISA::HACKX && a == 0 && c == HACKX_MOVE)
+        {
+            read = { bit_cast<uint16_t>(regs.D), (uint16_t)((ins & 077) + 1) };
+            write = { address, (uint16_t)((ins & 077) + 1) };
+            return;
+        }
+        if (a)
+            read = { address, 1 };
+        if (d & 0b001)
+            write = { address, 1 };
+    }
+
+    static bool ends_block(uint16_t ins, ISA isa)
+    {
+        bool is_move = isa == ISA::HACKX && (ins & 010000) == 0 && ((ins & 07700) >> 6) == HACKX_MOVE;
+        return get_instruction_type(ins) == InstructionType::C && !is_move && (ins & 07);
+    }
+
+    // Whether reaching pc, a label's NOP included, raises an instruction event
+    bool observes(uint16_t pc) const
+    {
+        for (const auto& p : instruction_probes)
+            if (p.range.contains(pc))
+                return true;
+        return false;
+    }
+
+    // Whether the instruction at pc can raise a registered event
+    bool wants(uint16_t pc, uint16_t ins, ISA isa) const
+    {
+        if (observes(pc))
+            return true;
+
+        REGISTERS regs{};
+        ACCESS read, write;
+        accesses(ins, regs, isa, read, write);
+        return (read.count && !read_probes.empty()) || (write.count && !write_probes.empty()) ||
+               (ends_block(ins, isa) && !block_probes.empty());
+    }
+
+    void block(const Motherboard& mbd)
+    {
+        for (const auto& p : block_probes)
+            if (p.range.contains(mbd.regs.PC))
+                p.callback(mbd, mbd.regs.PC);
+    }
+
+    // Call once before the first instruction of the run
+    void start(const Motherboard& mbd)
+    {
+        if (started)
+            return;
+        started = true;
+        block(mbd);
+    }
+
+    static void memory_events(const vector<PROBE<MEMORY_CALLBACK>>& probes, const Motherboard& mbd, uint16_t pc,
+                              ACCESS access)
+    {
+        for (uint16_t i = 0; i < access.count; ++i)
+            for (const auto& p : probes)
+                if (p.range.contains((uint16_t)(access.address + i)))
+                    p.callback(mbd, pc, (uint16_t)(access.address + i));
+    }
+
+    // Executes one instruction, the same as Motherboard::iterator::operator++, raising its events
+    void execute(Motherboard& mbd)
+    {
+        // Leading NOPs are skipped first, so events see the instruction that executes. A
+        // probe on a skipped NOP, such as the address of a label, fires for that instruction.
+        auto reached = mbd.regs.PC;
+        auto pc = reached;
+        while (pc < INSTRUCTION_COUNT && mbd.im[pc] == NOP)
+            ++pc;
+        if (pc >= INSTRUCTION_COUNT)
+        {
+            ++mbd.begin();
+            return;
+        }
+        mbd.regs.PC = pc;
+
+        uint16_t ins = mbd.im[pc];
+        for (const auto& p : instruction_probes)
+            if (p.range.from <= pc && p.range.to > reached)
+                p.callback(mbd, pc);
+
+        ACCESS read, write;
+        accesses(ins, mbd.regs, mbd.isa, read, write);
+        memory_events(read_probes, mbd, pc, read);
+
+        ++mbd.begin();
+
+        memory_events(write_probes, mbd, pc, write);
+        if (ends_block(ins, mbd.isa))
+            block(mbd);
+    }
+};
@@ -0,0 +1,231 @@
+#pragma once
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <vector>
+#include "Motherboard.h"
+
+// Native replacements for Jack OS routines. When PC reaches the ROM address of a
+// mapped function, the native body runs instead of the Hack code and the VM return
+// sequence is performed on its behalf, charging a configurable number of cycles.
+struct INTRINSICS
+{
+    struct NATIVE_FUNCTION
+    {
+        const char* name;
+        uint16_t n_args;
+        uint64_t default_cost;
+        int16_t (*impl)(INTRINSICS&, DATA_MEMORY&, uint16_t arg);
+    };
+
+    struct TRAP
+    {
+        const NATIVE_FUNCTION* function;
+        uint64_t cost;
+    };
+
+    static constexpr uint16_t HEAP_BASE = 2048;
+    static constexpr uint16_t HEAP_END = 16384;
+
+    vector<TRAP> traps;
+    vector<int16_t> trap_index = vector<int16_t>(INSTRUCTION_COUNT, -1);
+
+    // Native OS state
+    uint16_t heap_top = HEAP_BASE;
+    map<uint16_t, vector<uint16_t>> free_blocks;   // size -> block addresses
+    map<uint16_t, uint16_t> block_sizes;            // block address -> size
+    bool color = true;
+
+    static int16_t arg(DATA_MEMORY& dm, uint16_t base, uint16_t i) { return dm[base + i]; }
+
+    static int16_t multiply(INTRINSICS&, DATA_MEMORY& dm, uint16_t a)
+    {
+        return (int16_t)(arg(dm, a, 0) * arg(dm, a, 1));
+    }
+
+    static int16_t divide(INTRINSICS&, DATA_MEMORY& dm, uint16_t a)
+    {
+        if (arg(dm, a, 1) == 0)
+            throw runtime_error("Math.divide: division by zero");
+        return (int16_t)(arg(dm, a, 0) / arg(dm, a, 1));
+    }
+
+    static int16_t abs(INTRINSICS&, DATA_MEMORY& dm, uint16_t a)
+    {
+        return (int16_t)std::abs(arg(dm, a, 0));
+    }
+
+    static int16_t min(INTRINSICS&, DATA_MEMORY& dm, uint16_t a)
+    {
+        return std::min(arg(dm, a, 0), arg(dm, a, 1));
+    }
+
+    static int16_t max(INTRINSICS&, DATA_MEMORY& dm, uint16_t a)
+    {
+        return std::max(arg(dm, a, 0), arg(dm, a, 1));
+    }
+
+    static int16_t sqrt(INTRINSICS&, DATA_MEMORY& dm, uint16_t a)
+    {
+        int32_t x = arg(dm, a, 0), y = 0;
+        if (x < 0)
+            throw runtime_error("Math.sqrt: negative argument");
+        while ((y + 1) * (y + 1) <= x)
+            ++y;
+        return (int16_t)y;
+    }
+
+    static int16_t peek(INTRINSICS&, DATA_MEMORY& dm, uint16_t a)
+    {
+        return dm[bit_cast<uint16_t>(arg(dm, a, 0))];
+    }
+
+    static int16_t poke(INTRINSICS&, DATA_MEMORY& dm, uint16_t a)
+    {
+        dm[bit_cast<uint16_t>(arg(dm, a, 0))] = arg(dm, a, 1);
+        return 0;
+    }
+
+    static int16_t alloc(INTRINSICS& self, DATA_MEMORY& dm, uint16_t a)
+    {
+        auto size = arg(dm, a, 0);
+        if (size <= 0)
+            throw runtime_error(format("Memory.alloc: invalid size {}", size));
+
+        auto& reuse = self.free_blocks[size];
+        if (!reuse.empty())
+        {
+            auto block = reuse.back();
+            reuse.pop_back();
+            return (int16_t)block;
+        }
+
+        if (HEAP_END - self.heap_top < size)
+            throw runtime_error(format("Memory.alloc: heap overflow allocating {} words", size));
+
+        auto block = self.heap_top;
+        self.heap_top += size;
+        self.block_sizes[block] = size;
+        return (int16_t)block;
+    }
+
+    static int16_t de_alloc(INTRINSICS& self, DATA_MEMORY& dm, uint16_t a)
+    {
+        auto block = bit_cast<uint16_t>(arg(dm, a, 0));
+        auto it = self.block_sizes.find(block);
+        if (it == self.block_sizes.end())
+            throw runtime_error(format("Memory.deAlloc: 0x{:04X} is not an allocated block", block));
+
+        self.free_blocks[it->second].push_back(block);
+        return 0;
+    }
+
+    static int16_t set_color(INTRINSICS& self, DATA_MEMORY& dm, uint16_t a)
+    {
+        self.color = arg(dm, a, 0) != 0;
+        return 0;
+    }
+
+    static int16_t draw_rectangle(INTRINSICS& self, DATA_MEMORY& dm, uint16_t a)
+    {
+        int x1 = arg(dm, a, 0), y1 = arg(dm, a, 1), x2 = arg(dm, a, 2), y2 = arg(dm, a, 3);
+        if (x1 < 0 || y1 < 0 || x2 > 511 || y2 > 255 || x1 > x2 || y1 > y2)
+            throw runtime_error(format("Screen.drawRectangle: illegal coordinates ({}, {}, {}, {})", x1, y1, x2, y2));
+
+        for (int y = y1; y <= y2; ++y)
+            for (int x = x1; x <= x2; ++x)
+            {
+                auto& word = dm.screen[y * 32 + x / 16];
+                if (self.color)
+                    word = (int16_t)(word | (1 << (x & 15)));
+                else
+                    word = (int16_t)(word & ~(1 << (x & 15)));
+            }
+        return 0;
+    }
+
+    // Default costs approximate the cycle count of the Hack implementations.
+    static constexpr NATIVE_FUNCTION NATIVE_FUNCTIONS[] = {
+        { "Math.multiply", 2, 600, multiply },
+        { "Math.divide", 2, 900, divide },
+        { "Math.abs", 1, 60, abs },
+        { "Math.min", 2, 60, min },
+        { "Math.max", 2, 60, max },
+        { "Math.sqrt", 1, 2000, sqrt },
+        { "Memory.peek", 1, 60, peek },
+        { "Memory.poke", 2, 60, poke },
+        { "Memory.alloc", 1, 400, alloc },
+        { "Memory.deAlloc", 1, 200, de_alloc },
+        { "Screen.setColor", 1, 60, set_color },
+        { "Screen.drawRectangle", 4, 20000, draw_rectangle },
+    };
+
+    // Symbol map format, one function per line: <function name> <ROM address> [cycle cost]
+    void load_symbol_map(const string& path)
+    {
+        ifstream file{ path };
+        if (!file)
+            throw runtime_error(format("Unable to open file: {}", path));
+
+        string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            stringstream sstr{ line };
+            string name;
+            uint32_t address;
+            if (!(sstr >> name >> address) || address >= INSTRUCTION_COUNT)
+                throw runtime_error(format("Invalid symbol map line: '{}'", line));
+
+            auto function = find_if(begin(NATIVE_FUNCTIONS), end(NATIVE_FUNCTIONS),
+                                    [&](const NATIVE_FUNCTION& f) { return name == f.name; });
+            if (function == end(NATIVE_FUNCTIONS))
+                throw runtime_error(format("No native implementation for '{}'", name));
+
+            uint64_t cost = function->default_cost;
+            sstr >> cost;
+
+            trap_index[address] = (int16_t)traps.size();
+            traps.push_back({ function, cost });
+        }
+    }
+
+    // Runs the native function mapped at PC, if any, and performs the VM return:
+    // RAM[ARG] = result, SP = ARG + 1, THAT/THIS/ARG/LCL restored from the frame and
+    // PC set to the saved return address. The function cost is added to cycles. A PC past
+    // the ROM is left for the fetch to report.
+    bool trap(Motherboard& mbd, uint64_t& cycles)
+    {
+        if (traps.empty() || mbd.regs.PC >= INSTRUCTION_COUNT)
+            return false;
+
+        auto index = trap_index[mbd.regs.PC];
+        if (index < 0)
+            return false;
+
+        auto& t = traps[index];
+        auto& dm = mbd.dm;
+        auto arg_base = bit_cast<uint16_t>(dm[2]);
+        auto frame = bit_cast<uint16_t>(dm[1]);
+
+        dm[arg_base] = t.function->impl(*this, dm, arg_base);
+        dm[0] = (int16_t)(arg_base + 1);
+
+        int16_t return_address = dm[frame - 5];
+        dm[4] = dm[frame - 1];
+        dm[3] = dm[frame - 2];
+        dm[2] = dm[frame - 3];
+        dm[1] = dm[frame - 4];
+        dm[15] = return_address;
+
+        mbd.regs.D = dm[1];
+        mbd.regs.A = return_address;
+        mbd.regs.PC = bit_cast<uint16_t>(return_address);
+        cycles += t.cost;
+        return true;
+    }
+
+    bool empty() const { return traps.empty(); }
+};
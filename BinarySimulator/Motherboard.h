@@ -0,0 +1,662 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "../Common/Buffer.h"
+#include "../Common/RomImage.h"
+
+using namespace std;
+
+// Make sure we are using 2's complement representation.
+// https://stackoverflow.com/questions/64842669/how-to-test-if-a-target-has-twos-complement-integers-with-the-c-preprocessor
+#if (-1 & 3) == 1
+static_assert(false, "The system encoding is sign-and-magnitude. This program only compiles on two's complement system.");
+#elif (-1 & 3) == 2
+static_assert(false, "The system encoding is one’s complement. This program only compiles on two's complement system.");
+#elif (-1 & 3) != 3
+static_assert(false, "The system encoding is not possible in C standard. This program only compiles on two's complement system.");
+#endif
+
+const uint16_t RAM_SIZE  = 0x4000;
+const uint16_t SCREEN_SIZE = 0X2000;
+const uint16_t DATA_COUNT = RAM_SIZE + SCREEN_SIZE + 1;
+const uint16_t INSTRUCTION_COUNT = 0x8000;
+
+const auto TERMINATION_PC_ADDRESS = bit_cast<uint16_t>((int16_t) - 1);
+const auto NOP = bit_cast<uint16_t>((int16_t) - 1);
+
+enum class ISA : uint16_t
+{
+    HACK,
+    HACKX
+};
+
+// HackX comp code for block move; the d and j bits hold the word count - 1.
+const uint8_t HACKX_MOVE = 0b001000;
+
+enum class InstructionType : uint8_t
+{
+    A,
+    C,
+    ERROR
+};
+
+// Memory-mapped devices in the otherwise unused addresses above the keyboard (see Devices.h)
+struct DEVICE_BUS
+{
+    virtual ~DEVICE_BUS() = default;
+    virtual int16_t read(uint16_t address) = 0;
+    virtual void write(uint16_t address, int16_t value) = 0;
+};
+
+struct DATA_MEMORY
+{
+    array<int16_t, RAM_SIZE> ram{};
+    array<int16_t, SCREEN_SIZE> screen{};
+    int16_t keyboard{};
+    DEVICE_BUS* devices = nullptr;
+
+    constexpr int16_t* word(uint16_t address)
+    {
+        if ((address & 0b1100'0000'0000'0000) == 0)
+            return &ram[address];
+
+        if ((address & 0b1110'0000'0000'0000) == 0b0100'0000'0000'0000)
+            return &screen[address & 0b0001'1111'1111'1111];
+
+        if (address == 24576)
+            return &keyboard;
+
+        return nullptr;
+    }
+
+    constexpr const int16_t* word(uint16_t address) const
+    {
+        return const_cast<DATA_MEMORY*>(this)->word(address);
+    }
+
+    [[noreturn]] static void invalid_address(uint16_t address)
+    {
+        throw std::runtime_error(format("Trying to access invalid data memory location: 0x{:04X}\n",
+                                        address));
+    }
+
+    constexpr int16_t& operator[](uint16_t address)
+    {
+        if (auto p = word(address))
+            return *p;
+
+        invalid_address(address);
+    }
+
+    constexpr const int16_t operator[](uint16_t address) const
+    {
+        if (auto p = word(address))
+            return *p;
+
+        invalid_address(address);
+    }
+
+    // Accesses made by executing instructions. Only addresses outside RAM, screen and
+    // keyboard reach the device bus, so memory accesses pay nothing for it.
+    constexpr int16_t read(uint16_t address)
+    {
+        if (auto p = word(address))
+            return *p;
+
+        if (!devices)
+            invalid_address(address);
+        return devices->read(address);
+    }
+
+    constexpr void write(uint16_t address, int16_t value)
+    {
+        if (auto p = word(address))
+        {
+            *p = value;
+            return;
+        }
+
+        if (!devices)
+            invalid_address(address);
+        devices->write(address, value);
+    }
+};
+
+struct INSTRUCTION_MEMORY
+{
+    array<uint16_t, INSTRUCTION_COUNT> rom{};
+
+    [[noreturn]] static void invalid_address(uint16_t address)
+    {
+        throw std::out_of_range(format("Trying to access invalid instruction memory location: 0x{:04X}",
+                                       address));
+    }
+
+    constexpr uint16_t& operator[](uint16_t address)
+    {
+        if (address >= INSTRUCTION_COUNT)
+            invalid_address(address);
+        return rom[address];
+    }
+
+    constexpr const uint16_t& operator[](uint16_t address) const
+    {
+        if (address >= INSTRUCTION_COUNT)
+            invalid_address(address);
+        return rom[address];
+    }
+};
+
+struct REGISTERS
+{
+    int16_t D {};
+    int16_t A {};
+    uint16_t PC {};
+};
+
+[[nodiscard]]
+constexpr InstructionType get_instruction_type(uint16_t ins)
+{
+    bool A_instruction = !(ins >> 15);
+    bool D_instruction = ((ins >> 13) == 7);
+
+    if (A_instruction == D_instruction)
+        return InstructionType::ERROR;
+
+    if (A_instruction)
+        return InstructionType::A;
+
+    return InstructionType::C;
+}
+
+[[nodiscard]]
+constexpr int16_t ALU_a_0(REGISTERS& regs, uint8_t c)
+{
+    auto& A = regs.A;
+    auto& D = regs.D;
+
+    switch (c)
+    {
+        case 0b101010:
+            return 0;
+
+        case 0b111111:
+            return 1;
+
+        case 0b111010:
+            return -1;
+
+        case 0b001100:
+            return D;
+
+        case 0b110000:
+            return A;
+
+        case 0b001101:
+            return (int16_t)~D;
+
+        case 0b110001:
+            return (int16_t)~A;
+
+        case 0b001111:
+            return (int16_t)-D;
+
+        case 0b110011:
+            return (int16_t)-A;
+
+        case 0b011111:
+            return (int16_t)(D + 1);
+
+        case 0b110111:
+            return (int16_t)(A + 1);
+
+        case 0b001110:
+            return (int16_t)(D - 1);
+
+        case 0b110010:
+            return (int16_t)(A - 1);
+
+        case 0b000010:
+            return (int16_t)(D + A);
+
+        case 0b010011:
+            return (int16_t)(D - A);
+
+        case 0b000111:
+            return (int16_t)(A - D);
+
+        case 0b000000:
+            return (int16_t)(A & D);
+
+        case 0b010101:
+            return (int16_t)(D | A);
+
+        default:
+            throw std::runtime_error(format("Invalid instruction passed for comp bits: 0b0{:06b}\n",
+                                            c));
+    }
+}
+
+template <class MEMORY>
+[[nodiscard]]
+constexpr int16_t ALU_a_1(REGISTERS& regs, MEMORY& dm, uint8_t c)
+{
+    auto M = dm.read(bit_cast<uint16_t>(regs.A));
+    auto& D = regs.D;
+
+    switch (c)
+    {
+        case 0b110000:
+            return M;
+
+        case 0b110001:
+            return (int16_t)~M;
+
+        case 0b110011:
+            return (int16_t)-M;
+
+        case 0b110111:
+            return (int16_t)(M + 1);
+
+        case 0b110010:
+            return (int16_t)(M - 1);
+
+        case 0b000010:
+            return (int16_t)(D + M);
+
+        case 0b010011:
+            return (int16_t)(D - M);
+
+        case 0b000111:
+            return (int16_t)(M - D);
+
+        case 0b000000:
+            return (int16_t)(M & D);
+
+        case 0b010101:
+            return (int16_t)(D | M);
+
+        default:
+            throw std::runtime_error(format("Invalid instruction passed for comp bits: 0b1{:06b}\n",
+                                            c));
+    }
+}
+
+[[nodiscard]]
+constexpr bool is_valid_comp(uint8_t a, uint8_t c)
+{
+    constexpr uint8_t A0[] = { 0b101010, 0b111111, 0b111010, 0b001100, 0b110000, 0b001101,
+                               0b110001, 0b001111, 0b110011, 0b011111, 0b110111, 0b001110,
+                               0b110010, 0b000010, 0b010011, 0b000111, 0b000000, 0b010101 };
+    constexpr uint8_t A1[] = { 0b110000, 0b110001, 0b110011, 0b110111, 0b110010,
+                               0b000010, 0b010011, 0b000111, 0b000000, 0b010101 };
+
+    for (auto x : (a == 0 ? span<const uint8_t>(A0) : span<const uint8_t>(A1)))
+        if (x == c)
+            return true;
+    return false;
+}
+
+[[nodiscard]]
+constexpr bool is_hackx_comp(uint8_t a, uint8_t c)
+{
+    if (a == 0)
+        return c == 0b000001 || c == 0b000011 || c == 0b000100 ||
+               c == 0b000101 || c == 0b000110 || c == HACKX_MOVE;
+
+    return c == 0b000100 || c == 0b000101 || c == 0b000110;
+}
+
+// HackX extension of the ALU on comp codes that are invalid in Hack.
+// Shifts right are arithmetic, multiplication keeps the low 16 bits.
+template <class MEMORY>
+[[nodiscard]]
+constexpr int16_t ALU_hackx(REGISTERS& regs, MEMORY& dm, uint8_t a, uint8_t c)
+{
+    auto& D = regs.D;
+    if (a == 0)
+    {
+        auto& A = regs.A;
+        switch (c)
+        {
+            case 0b000001:
+                return (int16_t)(D << 1);
+
+            case 0b000011:
+                return (int16_t)(D >> 1);
+
+            case 0b000100:
+                return (int16_t)(A << 1);
+
+            case 0b000101:
+                return (int16_t)(A >> 1);
+
+            case 0b000110:
+                return (int16_t)(D * A);
+        }
+    }
+    else
+    {
+        auto M = dm.read(bit_cast<uint16_t>(regs.A));
+        switch (c)
+        {
+            case 0b000100:
+                return (int16_t)(M << 1);
+
+            case 0b000101:
+                return (int16_t)(M >> 1);
+
+            case 0b000110:
+                return (int16_t)(D * M);
+        }
+    }
+
+    throw std::runtime_error(format("Invalid instruction passed for HackX comp bits: 0b{:01b}{:06b}\n",
+                                    a, c));
+}
+
+// HackX block move: RAM[A .. A + count) = RAM[D .. D + count), overlap safe.
+template <class MEMORY>
+constexpr void block_move(REGISTERS& regs, MEMORY& dm, uint16_t count)
+{
+    auto src = bit_cast<uint16_t>(regs.D);
+    auto dst = bit_cast<uint16_t>(regs.A);
+
+    if (dst <= src)
+        for (uint16_t i = 0; i < count; ++i)
+            dm.write(dst + i, dm.read(src + i));
+    else
+        for (uint16_t i = count; i-- > 0;)
+            dm.write(dst + i, dm.read(src + i));
+}
+
+[[nodiscard]]
+constexpr bool should_jump(uint8_t j, int16_t alu_out)
+{
+    switch (j & 0b111)
+    {
+        case 0b000:
+            return false;
+
+        case 0b001:
+            return alu_out > 0;
+
+        case 0b010:
+            return alu_out == 0;
+
+        case 0b011:
+            return alu_out >= 0;
+
+        case 0b100:
+            return alu_out < 0;
+
+        case 0b101:
+            return alu_out != 0;
+
+        case 0b110:
+            return alu_out <= 0;
+
+        case 0b111:
+            return true;
+    }
+
+    throw std::runtime_error("Switch should have covered all jump cases.");
+}
+
+enum class STEP_FAULT : uint8_t
+{
+    NONE,
+    INVALID_INSTRUCTION,
+    INVALID_ADDRESS,
+    PC_OUT_OF_ROM
+};
+
+// Executes the instruction at PC, skipping NOPs before it. At run time faults throw from the
+// memories and the ALU. A throw cannot be caught during constant evaluation, so there each
+// of those conditions is checked before it is reached and returned instead.
+template <class DM, class IM>
+constexpr STEP_FAULT step(REGISTERS& regs, DM& dm, const IM& im, ISA isa)
+{
+    if (is_constant_evaluated() && regs.PC >= INSTRUCTION_COUNT)
+        return STEP_FAULT::PC_OUT_OF_ROM;
+    uint16_t ins = im[regs.PC];
+    while (ins == NOP)
+    {
+        if (is_constant_evaluated() && regs.PC + 1 >= INSTRUCTION_COUNT)
+            return STEP_FAULT::PC_OUT_OF_ROM;
+        ins = im[++regs.PC];
+    }
+
+    auto ins_type = get_instruction_type(ins);
+    if (ins_type == InstructionType::A)
+    {
+        regs.A = bit_cast<int16_t>(ins);
+        regs.PC = regs.PC + 1;
+        return STEP_FAULT::NONE;
+    }
+    if (ins_type != InstructionType::C)
+    {
+        if (is_constant_evaluated())
+            return STEP_FAULT::INVALID_INSTRUCTION;
+        throw runtime_error(format("Invalid instruction type encountered: 0x{:04X}", ins));
+    }
+
+
+    uint8_t j = ins & 07;
+    uint8_t d = (ins & 070) >> 3;
+    uint8_t c = (ins & 07700) >> 6;
+    uint8_t a = (ins & 010000) >> 12;
+    bool hackx = isa == ISA::HACKX && is_hackx_comp(a, c);
+    bool move = hackx && a == 0 && c == HACKX_MOVE;
+
+    if (is_constant_evaluated())
+    {
+        if (!hackx && !is_valid_comp(a, c))
+            return STEP_FAULT::INVALID_INSTRUCTION;
+
+        // a block move reads and writes count words from D and A, others one word at A
+        uint32_t count = move ? (ins & 077) + 1 : 1;
+        auto address = bit_cast<uint16_t>(regs.A);
+        if ((move && bit_cast<uint16_t>(regs.D) + count > DATA_COUNT) ||
+            ((move || a || (d & 0b001)) && address + count > DATA_COUNT))
+            return STEP_FAULT::INVALID_ADDRESS;
+    }
+
+    // get value
+    int16_t alu_out;
+    if (hackx)
+    {
+        if (move)
+        {
+            block_move(regs, dm, (ins & 077) + 1);
+            regs.PC += 1;
+            return STEP_FAULT::NONE;
+        }
+        alu_out = ALU_hackx(regs, dm, a, c);
+    }
+    else
+        alu_out = (a == 0 ? ALU_a_0(regs, c) : ALU_a_1(regs, dm, c));
+
+    // get jump
+    if (should_jump(j, alu_out))
+        regs.PC = regs.A;	// PC = PC + 1 will be executed later
+    else
+        regs.PC += 1;
+
+    // get destination
+    if (d & 0b001)
+        dm.write(regs.A, alu_out);
+    if (d & 0b010)
+        regs.D = alu_out;
+    if (d & 0b100)
+        regs.A = alu_out;
+
+    return STEP_FAULT::NONE;
+}
+
+// The data and instruction memories are parameters so that PagedMemory.h can provide
+// sparse variants; Motherboard is the flat layout used everywhere else.
+template <class DM, class IM>
+struct BASIC_MOTHERBOARD
+{
+    REGISTERS regs{};
+    DM dm{};
+    IM im{};
+    ISA isa = ISA::HACK;
+
+    struct STATUS
+    {
+        const REGISTERS& registers;
+        const uint16_t ins;
+        const optional<int16_t> memory{};
+    };
+
+    struct sentinel {};
+
+    struct iterator
+    {
+        DM& dm;
+        const IM& im;
+        REGISTERS& regs;
+        const ISA isa;
+
+        constexpr bool operator!=(sentinel) const { return regs.PC != TERMINATION_PC_ADDRESS; }
+        constexpr iterator& operator++()
+        {
+            // step() only returns a fault during constant evaluation, where this throw makes the
+            // evaluation fail as a faulting program does at run time
+            if (step(regs, dm, im, isa) != STEP_FAULT::NONE)
+                throw runtime_error("Instruction faulted during constant evaluation");
+            return *this;
+        }
+
+        const constexpr STATUS operator*() const
+        {
+            // Device registers are not read here, reads can have side effects
+            if (auto p = dm.word(regs.A))
+                return { regs, im[regs.PC], *p };
+
+            return { regs, im[regs.PC] };
+        }
+    };
+
+    constexpr iterator begin() { return iterator{ this->dm, this->im, this->regs, this->isa }; }
+    static constexpr sentinel end() { return {}; }
+};
+
+using Motherboard = BASIC_MOTHERBOARD<DATA_MEMORY, INSTRUCTION_MEMORY>;
+
+static_assert(offsetof(DATA_MEMORY, keyboard) == ((DATA_COUNT - 1) << 1));
+static_assert(sizeof(INSTRUCTION_MEMORY) == (INSTRUCTION_COUNT << 1));
+static_assert(sizeof(REGISTERS) == 6);
+static_assert(is_trivially_copyable_v<Motherboard>);
+
+// One word per line as binary digits; other characters are ignored
+inline uint16_t parse_binary_word(string_view line)
+{
+    uint16_t val = 0;
+    for (char c : line)
+    {
+        if (c != '0' && c != '1')
+            continue;
+
+        val <<= 1;
+        val |= (c - '0');
+    }
+    return val;
+}
+
+// ROM image flags of a program run with the given ISA and banking
+inline uint32_t rom_image_flags(ISA isa, bool banked = false)
+{
+    return (isa == ISA::HACKX ? ROM_IMAGE_HACKX : 0) | (banked ? ROM_IMAGE_BANKED : 0);
+}
+
+// Instruction and data files are text with one binary word per line, raw little-endian
+// words (.bin), or ROM images from `assembler.out --format=image`, recognised by their magic.
+// The file is mapped, the words are read in place. A ROM is loaded with the image flags it is
+// run with, an image assembled for another ISA or banking mode is rejected.
+inline void load_binary_file(string path, const function<void(size_t, uint16_t)>& f,
+                             optional<uint32_t> image_flags = nullopt)
+{
+    if (path.empty())
+        return;
+
+    if (!ifstream{ path })
+        throw runtime_error(format("Unable to open file: {}", path));
+
+    Buffer file(path.c_str());
+    string_view data = file.text();
+
+    auto words = [&](size_t offset, size_t count) {
+        if (offset + 2 * count > data.size())
+            throw runtime_error(format("Truncated ROM: {}", path));
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint16_t word;
+            memcpy(&word, data.data() + offset + 2 * i, 2);
+            f(i, word);
+        }
+    };
+
+    if (data.starts_with(string_view(ROM_IMAGE_MAGIC, sizeof(ROM_IMAGE_MAGIC))))
+    {
+        ROM_IMAGE_HEADER header;
+        if (data.size() < sizeof(header))
+            throw runtime_error(format("Truncated ROM image: {}", path));
+        memcpy(&header, data.data(), sizeof(header));
+        if (header.version != ROM_IMAGE_VERSION)
+            throw runtime_error(format("Unsupported ROM image version {}: {}", header.version, path));
+        if (image_flags && header.flags != *image_flags)
+        {
+            auto mode = [](uint32_t flags) {
+                return format("{}{}", flags & ROM_IMAGE_HACKX ? "--isa=hackx" : "--isa=hack",
+                              flags & ROM_IMAGE_BANKED ? " --banked" : "");
+            };
+            throw runtime_error(format("ROM image assembled for {} but run as {}: {}",
+                                       mode(header.flags), mode(*image_flags), path));
+        }
+        words(header.words.offset, header.words.count);
+        return;
+    }
+
+    if (path.ends_with(".bin"))
+    {
+        if (data.size() % 2 != 0)
+            throw runtime_error(format("Odd number of bytes in raw ROM: {}", path));
+        words(0, data.size() / 2);
+        return;
+    }
+
+    size_t i = 0;
+    for (size_t pos = 0; pos < data.size(); ++i)
+    {
+        size_t end = min(data.find('\n', pos), data.size());
+        f(i, parse_binary_word(data.substr(pos, end - pos)));
+        pos = end + 1;
+    }
+}
+
+// Runs the reference iterator until the program terminates or max_cycles
+// instructions have been executed. Returns the number of executed instructions.
+template <class DM, class IM>
+constexpr uint64_t run_reference(BASIC_MOTHERBOARD<DM, IM>& mbd, uint64_t max_cycles)
+{
+    uint64_t cycles = 0;
+    for (auto it = mbd.begin(); it != mbd.end() && cycles < max_cycles; ++it)
+        ++cycles;
+
+    return cycles;
+}
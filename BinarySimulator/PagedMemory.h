@@ -0,0 +1,217 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include "Motherboard.h"
+
+using namespace std;
+
+// Sparse data memory for hosting many simulations in one process. RAM and screen are split
+// into 256-word pages that all read the shared zero page until their first write allocates
+// them; a program touching the stack, a few statics and a little heap holds a handful of
+// pages instead of the full 48 KB. Reads are a page-table lookup without a branch, writes
+// check for the first write of the page.
+struct PAGED_DATA_MEMORY
+{
+    static constexpr uint16_t PAGE_SIZE = 256;
+    static constexpr uint16_t PAGE_COUNT = (RAM_SIZE + SCREEN_SIZE) / PAGE_SIZE;
+    using PAGE = array<int16_t, PAGE_SIZE>;
+    static inline const PAGE ZERO_PAGE{};
+
+    array<const int16_t*, PAGE_COUNT> read_pages;
+    array<unique_ptr<PAGE>, PAGE_COUNT> pages{};
+    int16_t keyboard{};
+    DEVICE_BUS* devices = nullptr;
+
+    PAGED_DATA_MEMORY() { read_pages.fill(ZERO_PAGE.data()); }
+
+    PAGED_DATA_MEMORY(const PAGED_DATA_MEMORY& other) : PAGED_DATA_MEMORY()
+    {
+        *this = other;
+    }
+
+    PAGED_DATA_MEMORY& operator=(const PAGED_DATA_MEMORY& other)
+    {
+        if (this == &other)
+            return *this;
+
+        for (uint16_t p = 0; p < PAGE_COUNT; ++p)
+        {
+            pages[p] = other.pages[p] ? make_unique<PAGE>(*other.pages[p]) : nullptr;
+            read_pages[p] = pages[p] ? pages[p]->data() : ZERO_PAGE.data();
+        }
+        keyboard = other.keyboard;
+        devices = other.devices;
+        return *this;
+    }
+
+    // RAM and screen are contiguous in the address space, not in the flat layout's arrays
+    template <class FLAT>
+    static auto flat_page(FLAT& dm, uint16_t page)
+    {
+        uint16_t address = page * PAGE_SIZE;
+        return address < RAM_SIZE ? &dm.ram[address] : &dm.screen[address - RAM_SIZE];
+    }
+
+    // Only pages holding non-zero words are allocated
+    explicit PAGED_DATA_MEMORY(const DATA_MEMORY& dm) : PAGED_DATA_MEMORY()
+    {
+        for (uint16_t p = 0; p < PAGE_COUNT; ++p)
+        {
+            auto from = flat_page(dm, p);
+            if (any_of(from, from + PAGE_SIZE, [](int16_t word) { return word != 0; }))
+                copy(from, from + PAGE_SIZE, allocate(p));
+        }
+        keyboard = dm.keyboard;
+        devices = dm.devices;
+    }
+
+    void copy_to(DATA_MEMORY& dm) const
+    {
+        for (uint16_t p = 0; p < PAGE_COUNT; ++p)
+            copy(read_pages[p], read_pages[p] + PAGE_SIZE, flat_page(dm, p));
+        dm.keyboard = keyboard;
+    }
+
+    size_t allocated_pages() const
+    {
+        return count_if(pages.begin(), pages.end(), [](const auto& page) { return page != nullptr; });
+    }
+
+    // Bytes held by this instance, page table included
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + allocated_pages() * sizeof(PAGE);
+    }
+
+    int16_t* allocate(uint16_t page)
+    {
+        pages[page] = make_unique<PAGE>();
+        read_pages[page] = pages[page]->data();
+        return pages[page]->data();
+    }
+
+    // Read-only view of the word, nullptr outside RAM, screen and keyboard
+    const int16_t* word(uint16_t address) const
+    {
+        if (address < RAM_SIZE + SCREEN_SIZE)
+            return &read_pages[address / PAGE_SIZE][address % PAGE_SIZE];
+
+        if (address == 24576)
+            return &keyboard;
+
+        return nullptr;
+    }
+
+    int16_t& operator[](uint16_t address)
+    {
+        if (address < RAM_SIZE + SCREEN_SIZE)
+        {
+            auto page = pages[address / PAGE_SIZE] ? pages[address / PAGE_SIZE]->data() : allocate(address / PAGE_SIZE);
+            return page[address % PAGE_SIZE];
+        }
+
+        if (address == 24576)
+            return keyboard;
+
+        DATA_MEMORY::invalid_address(address);
+    }
+
+    const int16_t operator[](uint16_t address) const
+    {
+        if (auto p = word(address))
+            return *p;
+
+        DATA_MEMORY::invalid_address(address);
+    }
+
+    int16_t read(uint16_t address)
+    {
+        if (auto p = word(address))
+            return *p;
+
+        if (!devices)
+            DATA_MEMORY::invalid_address(address);
+        return devices->read(address);
+    }
+
+    void write(uint16_t address, int16_t value)
+    {
+        if (address < RAM_SIZE + SCREEN_SIZE)
+        {
+            auto page = pages[address / PAGE_SIZE].get();
+            auto data = page ? page->data() : allocate(address / PAGE_SIZE);
+            data[address % PAGE_SIZE] = value;
+            return;
+        }
+
+        if (address == 24576)
+        {
+            keyboard = value;
+            return;
+        }
+
+        if (!devices)
+            DATA_MEMORY::invalid_address(address);
+        devices->write(address, value);
+    }
+};
+
+// Sparse ROM whose pages are shared read-only between copies. Copying the instruction
+// memory of a loaded program costs a page table, and the first write to a shared page
+// (loading, or patching a copy) gives that copy its own page.
+struct PAGED_INSTRUCTION_MEMORY
+{
+    static constexpr uint16_t PAGE_SIZE = 256;
+    static constexpr uint16_t PAGE_COUNT = INSTRUCTION_COUNT / PAGE_SIZE;
+    using PAGE = array<uint16_t, PAGE_SIZE>;
+    static inline const PAGE ZERO_PAGE{};
+
+    array<const uint16_t*, PAGE_COUNT> read_pages;
+    array<shared_ptr<PAGE>, PAGE_COUNT> pages{};
+
+    PAGED_INSTRUCTION_MEMORY() { read_pages.fill(ZERO_PAGE.data()); }
+
+    // Only pages holding non-zero words are allocated
+    explicit PAGED_INSTRUCTION_MEMORY(const INSTRUCTION_MEMORY& im) : PAGED_INSTRUCTION_MEMORY()
+    {
+        for (uint16_t address = 0; address < INSTRUCTION_COUNT; ++address)
+            if (im[address] != 0)
+                (*this)[address] = im[address];
+    }
+
+    // Bytes of pages this copy does not share with another one, page table included
+    size_t memory_bytes() const
+    {
+        size_t bytes = sizeof(*this);
+        for (const auto& page : pages)
+            if (page && page.use_count() == 1)
+                bytes += sizeof(PAGE);
+        return bytes;
+    }
+
+    const uint16_t& operator[](uint16_t address) const
+    {
+        if (address >= INSTRUCTION_COUNT)
+            INSTRUCTION_MEMORY::invalid_address(address);
+
+        return read_pages[address / PAGE_SIZE][address % PAGE_SIZE];
+    }
+
+    uint16_t& operator[](uint16_t address)
+    {
+        if (address >= INSTRUCTION_COUNT)
+            INSTRUCTION_MEMORY::invalid_address(address);
+
+        auto& page = pages[address / PAGE_SIZE];
+        if (!page || page.use_count() > 1)
+        {
+            page = page ? make_shared<PAGE>(*page) : make_shared<PAGE>();
+            read_pages[address / PAGE_SIZE] = page->data();
+        }
+        return (*page)[address % PAGE_SIZE];
+    }
+};
+
+using PAGED_MOTHERBOARD = BASIC_MOTHERBOARD<PAGED_DATA_MEMORY, PAGED_INSTRUCTION_MEMORY>;
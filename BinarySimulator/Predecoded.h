@@ -0,0 +1,195 @@
+#pragma once
+#include <vector>
+#include "Instrumentation.h"
+#include "Motherboard.h"
+
+// Predecoded execution engine. The ROM is decoded once into fixed-size entries: NOP
+// runs are folded into the entry of the instruction that follows them, and the comp
+// bits are turned into the masks of the Hack ALU (zx, nx, zy, ny, f, no), so a
+// C-instruction is evaluated without a switch. Anything the fast path does not cover
+// (invalid instructions, running off the ROM) falls back to the reference iterator,
+// which raises the same errors. With instrumentation, the instructions that raise its
+// events are decoded as probes instead, which run through the instrumentation.
+struct PREDECODED_ROM
+{
+    enum class OP : uint8_t
+    {
+        LOAD_A,
+        ALU,
+        HACKX_ALU,
+        HACKX_MOVE,
+        REFERENCE,
+        PROBE
+    };
+
+    struct ENTRY
+    {
+        OP op = OP::REFERENCE;
+        uint8_t a{};
+        uint8_t c{};
+        uint8_t d{};
+        uint8_t j{};
+        uint16_t value{};           // A constant or block move count
+        uint16_t next{};            // PC when the jump is not taken
+        int16_t zx{}, nx{}, zy{}, ny{}, f{}, no{};
+    };
+
+    vector<ENTRY> code = vector<ENTRY>(INSTRUCTION_COUNT);
+    INSTRUMENTATION* tools = nullptr;
+
+    [[nodiscard]]
+    static constexpr ENTRY decode_instruction(uint16_t ins, ISA isa)
+    {
+        ENTRY e{};
+        auto type = get_instruction_type(ins);
+        if (type == InstructionType::A)
+        {
+            e.op = OP::LOAD_A;
+            e.value = ins;
+            return e;
+        }
+        if (type != InstructionType::C)
+            return e;
+
+        e.j = ins & 07;
+        e.d = (ins & 070) >> 3;
+        e.c = (ins & 07700) >> 6;
+        e.a = (ins & 010000) >> 12;
+
+        if (isa == ISA::HACKX && is_hackx_comp(e.a, e.c))
+        {
+            e.op = (e.a == 0 && e.c == HACKX_MOVE) ? OP::HACKX_MOVE : OP::HACKX_ALU;
+            e.value = (ins & 077) + 1;
+            return e;
+        }
+        if (!is_valid_comp(e.a, e.c))
+            return e;
+
+        e.op = OP::ALU;
+        e.zx = (e.c & 0b100000) ? 0 : -1;
+        e.nx = (e.c & 0b010000) ? -1 : 0;
+        e.zy = (e.c & 0b001000) ? 0 : -1;
+        e.ny = (e.c & 0b000100) ? -1 : 0;
+        e.f = (e.c & 0b000010) ? -1 : 0;
+        e.no = (e.c & 0b000001) ? -1 : 0;
+        return e;
+    }
+
+    void decode(const INSTRUCTION_MEMORY& im, ISA isa, INSTRUMENTATION* instrumentation = nullptr)
+    {
+        tools = instrumentation && !instrumentation->empty() ? instrumentation : nullptr;
+
+        // Walk backwards so every NOP can take over the entry that follows it
+        ENTRY end_of_rom{};
+        for (uint32_t pc = INSTRUCTION_COUNT; pc-- > 0;)
+        {
+            if (im[pc] == NOP)
+            {
+                code[pc] = pc + 1 < INSTRUCTION_COUNT ? code[pc + 1] : end_of_rom;
+                if (tools && tools->observes(pc))
+                    code[pc].op = OP::PROBE;
+                continue;
+            }
+
+            code[pc] = decode_instruction(im[pc], isa);
+            code[pc].next = pc + 1;
+            if (tools && tools->wants(pc, im[pc], isa))
+                code[pc].op = OP::PROBE;
+        }
+    }
+
+    // Executes up to max_cycles instructions, each the same as Motherboard::iterator::operator++.
+    // Registers are kept in locals: stores to data memory could alias them otherwise.
+    uint64_t run(Motherboard& mbd, uint64_t max_cycles) const
+    {
+        auto& dm = mbd.dm;
+        int16_t A = mbd.regs.A;
+        int16_t D = mbd.regs.D;
+        uint16_t PC = mbd.regs.PC;
+
+        if (tools)
+            tools->start(mbd);
+
+        uint64_t cycles = 0;
+        try
+        {
+            for (; PC != TERMINATION_PC_ADDRESS && cycles < max_cycles; ++cycles)
+            {
+                const ENTRY& e = code[PC < INSTRUCTION_COUNT ? PC : 0];
+                if (PC >= INSTRUCTION_COUNT || e.op >= OP::REFERENCE)
+                {
+                    mbd.regs = { D, A, PC };
+                    auto sync = [&] { A = mbd.regs.A; D = mbd.regs.D; PC = mbd.regs.PC; };
+                    try
+                    {
+                        if (e.op == OP::PROBE)
+                            tools->execute(mbd);
+                        else
+                            ++mbd.begin();
+                    }
+                    catch (...)
+                    {
+                        sync();
+                        throw;
+                    }
+                    sync();
+                    continue;
+                }
+
+                if (e.op == OP::LOAD_A)
+                {
+                    A = bit_cast<int16_t>(e.value);
+                    PC = e.next;
+                    continue;
+                }
+
+                // Skip over folded NOPs, as the reference does before it may fail
+                PC = e.next - 1;
+
+                int16_t alu_out;
+                if (e.op == OP::ALU)
+                {
+                    int16_t x = (int16_t)((D & e.zx) ^ e.nx);
+                    int16_t y = (int16_t)(((e.a ? dm.read(bit_cast<uint16_t>(A)) : A) & e.zy) ^ e.ny);
+                    alu_out = (int16_t)((((x + y) & e.f) | ((x & y) & ~e.f)) ^ e.no);
+                }
+                else
+                {
+                    REGISTERS regs{ D, A, PC };
+                    if (e.op == OP::HACKX_MOVE)
+                    {
+                        block_move(regs, dm, e.value);
+                        PC = e.next;
+                        continue;
+                    }
+                    alu_out = ALU_hackx(regs, dm, e.a, e.c);
+                }
+
+                // j bits: 100 < 0, 010 == 0, 001 > 0
+                uint8_t sign = alu_out < 0 ? 0b100 : alu_out == 0 ? 0b010 : 0b001;
+                PC = (e.j & sign) ? bit_cast<uint16_t>(A) : e.next;
+
+                if (e.d & 0b001)
+                    dm.write(bit_cast<uint16_t>(A), alu_out);
+                if (e.d & 0b010)
+                    D = alu_out;
+                if (e.d & 0b100)
+                    A = alu_out;
+            }
+        }
+        catch (...)
+        {
+            // Leave the registers as the reference would after a failing instruction
+            mbd.regs = { D, A, PC };
+            throw;
+        }
+
+        mbd.regs = { D, A, PC };
+        return cycles;
+    }
+
+    void step(Motherboard& mbd) const
+    {
+        run(mbd, 1);
+    }
+};
@@ -0,0 +1,211 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <vector>
+#include "Motherboard.h"
+
+// Memory-access profiler. One instruction in sample_period is decoded before it executes
+// to find the data words it reads (a = 1, or the source of a HackX block move) and writes
+// (dest M, or the destination of a block move). Counts are kept per word and per ROM
+// address in flat arrays and scaled up by the period in the report; page counts are
+// summed from the word counts. The gaps between samples are drawn at random around the
+// period, a fixed gap would line up with the loops of the program and miss whole
+// instructions. Between samples the only work is a countdown and the stack high-water
+// mark, which is exact.
+struct PROFILER
+{
+    static constexpr uint16_t PAGE_SIZE = 256;
+    static constexpr uint16_t STACK_BASE = 256;
+    static constexpr uint16_t HEAP_BASE = 2048;
+    static constexpr uint16_t HEAP_END = 16384;
+
+    struct REGION
+    {
+        const char* name;
+        uint16_t from;
+        uint16_t to;        // exclusive
+    };
+
+    static constexpr REGION REGIONS[] = {
+        { "pointers (SP, LCL, ARG, THIS, THAT)", 0, 5 },
+        { "temp (R5-R12)", 5, 13 },
+        { "general (R13-R15)", 13, 16 },
+        { "static", 16, STACK_BASE },
+        { "stack", STACK_BASE, HEAP_BASE },
+        { "heap", HEAP_BASE, HEAP_END },
+        { "screen", HEAP_END, HEAP_END + SCREEN_SIZE },
+        { "keyboard", HEAP_END + SCREEN_SIZE, DATA_COUNT },
+    };
+
+    vector<uint64_t> reads = vector<uint64_t>(DATA_COUNT);
+    vector<uint64_t> writes = vector<uint64_t>(DATA_COUNT);
+    vector<uint64_t> rom_reads = vector<uint64_t>(INSTRUCTION_COUNT);
+    vector<uint64_t> rom_writes = vector<uint64_t>(INSTRUCTION_COUNT);
+
+    int16_t sp_high_water = 0;
+    uint16_t heap_high_water = 0;       // highest heap address written, 0 if none
+
+    uint64_t sample_period;
+    uint64_t countdown = 1;
+    uint64_t random = 0x9E3779B97F4A7C15u;      // xorshift64 state
+
+    // A period of 1 counts every access
+    explicit PROFILER(uint64_t sample_period) : sample_period{ max<uint64_t>(sample_period, 1) } {}
+
+    // 1 to 2 * sample_period - 1 instructions, sample_period on average
+    uint64_t next_gap()
+    {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        return 1 + random % (2 * sample_period - 1);
+    }
+
+    void record_write(uint16_t pc, uint16_t address)
+    {
+        if (address >= DATA_COUNT)
+            return;
+
+        ++writes[address];
+        ++rom_writes[pc];
+        if (address >= HEAP_BASE && address < HEAP_END && address > heap_high_water)
+            heap_high_water = address;
+    }
+
+    void record_read(uint16_t pc, uint16_t address)
+    {
+        if (address >= DATA_COUNT)
+            return;
+
+        ++reads[address];
+        ++rom_reads[pc];
+    }
+
+    // Counts the accesses of the instruction at PC, before it executes
+    void sample(const Motherboard& mbd)
+    {
+        auto pc = mbd.regs.PC;
+        if (pc == TERMINATION_PC_ADDRESS)
+            return;
+        uint16_t ins = mbd.im[pc];
+        while (ins == NOP)
+            ins = mbd.im[++pc];
+
+        if (get_instruction_type(ins) != InstructionType::C)
+            return;
+
+        uint8_t d = (ins & 070) >> 3;
+        uint8_t c = (ins & 07700) >> 6;
+        uint8_t a = (ins & 010000) >> 12;
+        auto address = bit_cast<uint16_t>(mbd.regs.A);
+
+        if (mbd.isa == ISA::HACKX && a == 0 && c == HACKX_MOVE)
+        {
+            auto src = bit_cast<uint16_t>(mbd.regs.D);
+            for (uint16_t i = 0; i <= (ins & 077); ++i)
+            {
+                record_read(pc, src + i);
+                record_write(pc, address + i);
+            }
+            return;
+        }
+
+        if (a)
+            record_read(pc, address);
+        if (d & 0b001)
+            record_write(pc, address);
+    }
+
+    // Call after each instruction; every sample_period-th call samples the next one.
+    void after(const Motherboard& mbd)
+    {
+        sp_high_water = max(sp_high_water, mbd.dm.ram[0]);
+        if (--countdown == 0) [[unlikely]]
+        {
+            countdown = next_gap();
+            sample(mbd);
+        }
+    }
+
+    static char shade(uint64_t count, uint64_t max_count)
+    {
+        static constexpr char SHADES[] = " .:-=+*#%@";
+        if (count == 0)
+            return SHADES[0];
+
+        auto level = 1 + (int)(8 * log2((double)count) / log2((double)max(max_count, uint64_t{ 2 })));
+        return SHADES[min(level, 9)];
+    }
+
+    void report(ostream& out, size_t top = 20) const
+    {
+        uint64_t total_reads = 0, total_writes = 0;
+        for (size_t i = 0; i < DATA_COUNT; ++i)
+        {
+            total_reads += reads[i];
+            total_writes += writes[i];
+        }
+
+        auto n = sample_period;
+        if (n > 1)
+            out << format("Sampled one instruction in {}, counts are scaled up. Words used and the heap mark only\n"
+                          "see sampled instructions, the stack mark is exact.\n\n", n);
+        out << format("Memory accesses: {} reads, {} writes\n\n", total_reads * n, total_writes * n);
+
+        out << format("{:<38}{:>14}{:>14}{:>12}\n", "Region", "Reads", "Writes", "Words used");
+        for (auto& region : REGIONS)
+        {
+            uint64_t r = 0, w = 0, used = 0;
+            for (uint32_t i = region.from; i < region.to; ++i)
+            {
+                r += reads[i];
+                w += writes[i];
+                used += (reads[i] || writes[i]);
+            }
+            out << format("{:<38}{:>14}{:>14}{:>12}\n", region.name, r * n, w * n, used);
+        }
+
+        out << format("\nStack high-water mark: SP = {} ({} words used of {})\n",
+                      sp_high_water, max(0, sp_high_water - STACK_BASE), HEAP_BASE - STACK_BASE);
+        if (heap_high_water)
+            out << format("Heap high-water mark: {} ({} words above heap base)\n",
+                          heap_high_water, heap_high_water - HEAP_BASE + 1);
+        else
+            out << "Heap high-water mark: heap not written\n";
+        out << format("Stack to heap margin: {} words\n", HEAP_BASE - max<int>(sp_high_water, STACK_BASE));
+
+        // Heatmap: one character per 256-word page, 16 pages per row
+        vector<uint64_t> pages((DATA_COUNT + PAGE_SIZE - 1) / PAGE_SIZE);
+        for (size_t i = 0; i < DATA_COUNT; ++i)
+            pages[i / PAGE_SIZE] += reads[i] + writes[i];
+        auto max_page = *max_element(pages.begin(), pages.end());
+
+        out << "\nHeatmap (one column per 256-word page, ' ' = untouched, '@' = hottest):\n";
+        for (size_t row = 0; row < pages.size(); row += 16)
+        {
+            out << format("0x{:04X} |", row * PAGE_SIZE);
+            for (size_t p = row; p < min(pages.size(), row + 16); ++p)
+                out << shade(pages[p], max_page);
+            out << "|\n";
+        }
+
+        auto print_top = [&](const char* title, const vector<uint64_t>& r, const vector<uint64_t>& w) {
+            vector<size_t> order;
+            for (size_t i = 0; i < r.size(); ++i)
+                if (r[i] || w[i])
+                    order.push_back(i);
+
+            auto rows = min(top, order.size());
+            partial_sort(order.begin(), order.begin() + rows, order.end(),
+                         [&](size_t x, size_t y) { return r[x] + w[x] > r[y] + w[y]; });
+
+            out << format("\n{}\n{:<10}{:>14}{:>14}\n", title, "Address", "Reads", "Writes");
+            for (size_t i = 0; i < rows; ++i)
+                out << format("{:<10}{:>14}{:>14}\n", order[i], r[order[i]] * n, w[order[i]] * n);
+        };
+
+        print_top("Hottest data words:", reads, writes);
+        print_top("ROM addresses by memory accesses:", rom_reads, rom_writes);
+    }
+};
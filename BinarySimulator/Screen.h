@@ -0,0 +1,198 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "Motherboard.h"
+
+// Live terminal view of the screen map, drawn with braille characters (2x4 pixels per
+// cell) on stdout by a separate thread at a fixed refresh rate. The execution thread
+// only copies the screen into a free slot every few thousand cycles; slots are swapped
+// lock-free (a double buffer plus a spare slot, so neither side ever waits) and the
+// renderer always draws a complete snapshot. Host keystrokes read by the render thread
+// are handed back to the execution thread, which stores them in the keyboard word.
+class SCREEN_RENDERER
+{
+    using SNAPSHOT = array<int16_t, SCREEN_SIZE>;
+
+    static constexpr uint8_t DIRTY = 0b100;
+
+    array<SNAPSHOT, 3> slots{};
+    uint8_t write_slot = 0;
+    uint8_t read_slot = 1;
+    atomic<uint8_t> spare_slot{ 2 };
+
+    atomic<int16_t> key{};
+    atomic<bool> stop{};
+    int scale;
+    chrono::milliseconds frame_time;
+    bool raw_terminal = false;
+    termios saved_terminal{};
+    thread renderer;
+
+    // Hack keyboard codes for the escape sequences of special keys
+    static int16_t decode_escape(const string& seq)
+    {
+        if (seq == "[A") return 131;
+        if (seq == "[B") return 133;
+        if (seq == "[C") return 132;
+        if (seq == "[D") return 130;
+        if (seq == "[H" || seq == "[1~") return 134;
+        if (seq == "[F" || seq == "[4~") return 135;
+        if (seq == "[5~") return 136;
+        if (seq == "[6~") return 137;
+        if (seq == "[2~") return 138;
+        if (seq == "[3~") return 139;
+        if (seq.size() == 2 && seq[0] == 'O' && seq[1] >= 'P' && seq[1] <= 'S')
+            return (int16_t)(141 + seq[1] - 'P');
+        return 0;
+    }
+
+    void read_keys(chrono::steady_clock::time_point& key_deadline)
+    {
+        char buf[16];
+        pollfd fd{ STDIN_FILENO, POLLIN, 0 };
+        while (poll(&fd, 1, 0) > 0)
+        {
+            auto n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n <= 0)
+                return;
+
+            int16_t code = 0;
+            if (buf[0] == 27 && n > 1)
+                code = decode_escape(string(buf + 1, n - 1));
+            else if (buf[0] == 27)
+                code = 140;
+            else if (buf[0] == '\n' || buf[0] == '\r')
+                code = 128;
+            else if (buf[0] == 127 || buf[0] == 8)
+                code = 129;
+            else if (buf[0] >= 32 && buf[0] < 127)
+                code = buf[0];
+
+            if (code != 0)
+            {
+                // Terminals report no key releases: hold the key for a short while
+                key.store(code, memory_order_relaxed);
+                key_deadline = chrono::steady_clock::now() + chrono::milliseconds(150);
+            }
+        }
+    }
+
+    void draw(const SNAPSHOT& screen, string& frame) const
+    {
+        auto pixel = [&](int x, int y) {
+            for (int dy = 0; dy < scale; ++dy)
+                for (int dx = 0; dx < scale; ++dx)
+                {
+                    int px = x * scale + dx, py = y * scale + dy;
+                    if (screen[py * 32 + px / 16] & (1 << (px & 15)))
+                        return true;
+                }
+            return false;
+        };
+
+        static constexpr int DOT[4][2] = { { 0, 3 }, { 1, 4 }, { 2, 5 }, { 6, 7 } };
+        int width = 512 / scale, height = 256 / scale;
+
+        frame = "\x1b[H";
+        for (int y = 0; y < height; y += 4)
+        {
+            for (int x = 0; x < width; x += 2)
+            {
+                int dots = 0;
+                for (int dy = 0; dy < 4 && y + dy < height; ++dy)
+                    for (int dx = 0; dx < 2; ++dx)
+                        if (pixel(x + dx, y + dy))
+                            dots |= 1 << DOT[dy][dx];
+
+                // U+2800 + dots, UTF-8 encoded
+                int cp = 0x2800 + dots;
+                frame += (char)(0xE0 | (cp >> 12));
+                frame += (char)(0x80 | ((cp >> 6) & 0x3F));
+                frame += (char)(0x80 | (cp & 0x3F));
+            }
+            frame += '\n';
+        }
+    }
+
+    void render_loop()
+    {
+        string frame;
+        auto key_deadline = chrono::steady_clock::time_point::max();
+        auto next_frame = chrono::steady_clock::now();
+
+        fputs("\x1b[2J\x1b[?25l", stdout);
+        while (true)
+        {
+            bool stopping = stop.load(memory_order_acquire);
+
+            if (raw_terminal)
+                read_keys(key_deadline);
+            if (chrono::steady_clock::now() > key_deadline)
+            {
+                key.store(0, memory_order_relaxed);
+                key_deadline = chrono::steady_clock::time_point::max();
+            }
+
+            if (spare_slot.load(memory_order_relaxed) & DIRTY)
+            {
+                auto previous = spare_slot.exchange(read_slot, memory_order_acq_rel);
+                read_slot = previous & ~DIRTY;
+                draw(slots[read_slot], frame);
+                fwrite(frame.data(), 1, frame.size(), stdout);
+                fflush(stdout);
+            }
+
+            if (stopping)
+                break;
+
+            next_frame += frame_time;
+            this_thread::sleep_until(next_frame);
+        }
+        fputs("\x1b[?25h", stdout);
+        fflush(stdout);
+    }
+
+public:
+    SCREEN_RENDERER(int scale, int refresh_rate)
+        : scale{ scale }, frame_time{ 1000 / max(1, refresh_rate) }
+    {
+        if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &saved_terminal) == 0)
+        {
+            termios raw = saved_terminal;
+            raw.c_lflag &= ~(ICANON | ECHO);
+            raw.c_cc[VMIN] = 0;
+            raw.c_cc[VTIME] = 0;
+            raw_terminal = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+        }
+
+        renderer = thread(&SCREEN_RENDERER::render_loop, this);
+    }
+
+    SCREEN_RENDERER(const SCREEN_RENDERER&) = delete;
+    SCREEN_RENDERER& operator=(const SCREEN_RENDERER&) = delete;
+
+    // Called from the execution thread: copies the screen into the write slot, hands
+    // it over to the renderer and returns the key currently held on the host keyboard.
+    int16_t publish(const DATA_MEMORY& dm)
+    {
+        slots[write_slot] = dm.screen;
+        auto previous = spare_slot.exchange(write_slot | DIRTY, memory_order_acq_rel);
+        write_slot = previous & ~DIRTY;
+        return key.load(memory_order_relaxed);
+    }
+
+    ~SCREEN_RENDERER()
+    {
+        stop.store(true, memory_order_release);
+        renderer.join();
+
+        if (raw_terminal)
+            tcsetattr(STDIN_FILENO, TCSANOW, &saved_terminal);
+    }
+};
@@ -0,0 +1,282 @@
+#pragma once
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <vector>
+#include "Predecoded.h"
+
+// Resident simulator driven over stdin/stdout. Every request and response is a frame:
+// a little-endian uint32 payload length followed by the payload. A request payload is
+// an opcode byte and its arguments; a response payload is a status byte (0 = ok,
+// 1 = error followed by the message) and the result. All integers are little-endian.
+//
+//   LOAD_ROM       u16 words...            load ROM from address 0, clear the rest
+//   LOAD_RAM       u16 address, u16 words...
+//   SET_REGISTERS  i16 A, i16 D, u16 PC
+//   GET_REGISTERS                      ->  i16 A, i16 D, u16 PC
+//   RUN            u64 max_cycles      ->  u64 cycles, u8 finished
+//   READ_MEMORY    u16 address, u16 count -> u16 words...
+//   SNAPSHOT                           ->  u32 id (registers and data memory)
+//   RESTORE        u32 id
+//   DISCARD        u32 id
+//   RESET                                  clear registers and data memory
+//   SET_ISA        u8 isa (0 = hack, 1 = hackx)
+//   QUIT
+//
+// The ROM is predecoded once per LOAD_ROM / SET_ISA and reused by every RUN.
+class SERVER
+{
+public:
+    enum class OPCODE : uint8_t
+    {
+        QUIT,
+        LOAD_ROM,
+        LOAD_RAM,
+        SET_REGISTERS,
+        GET_REGISTERS,
+        RUN,
+        READ_MEMORY,
+        SNAPSHOT,
+        RESTORE,
+        DISCARD,
+        RESET,
+        SET_ISA
+    };
+
+private:
+    struct SNAPSHOT_STATE
+    {
+        REGISTERS regs;
+        DATA_MEMORY dm;
+    };
+
+    struct READER
+    {
+        const vector<uint8_t>& data;
+        size_t at = 1;
+
+        uint64_t get(int bytes)
+        {
+            if (at + bytes > data.size())
+                throw runtime_error("Truncated request");
+
+            uint64_t val = 0;
+            for (int i = 0; i < bytes; ++i)
+                val |= (uint64_t)data[at++] << (8 * i);
+            return val;
+        }
+
+        uint16_t u16() { return (uint16_t)get(2); }
+        uint32_t u32() { return (uint32_t)get(4); }
+        uint64_t u64() { return get(8); }
+        bool done() const { return at == data.size(); }
+    };
+
+    // Payload length of each opcode, 0 for LOAD_ROM and LOAD_RAM which check their own
+    static constexpr size_t REQUEST_SIZE[] = { 1, 0, 0, 7, 1, 9, 5, 1, 5, 5, 1, 2 };
+
+    // Largest valid request: LOAD_RAM of the whole data memory
+    static constexpr uint32_t MAX_REQUEST = 1 + 2 + 2 * std::max<uint32_t>(INSTRUCTION_COUNT, DATA_COUNT);
+
+    FILE* in;
+    FILE* out;
+    bool oversized = false;                 // the last frame was longer than MAX_REQUEST
+    unique_ptr<Motherboard> mbd = make_unique<Motherboard>();
+    unique_ptr<PREDECODED_ROM> rom = make_unique<PREDECODED_ROM>();
+    map<uint32_t, unique_ptr<SNAPSHOT_STATE>> snapshots;
+    uint32_t next_snapshot = 1;
+    vector<uint8_t> response;
+
+    static void put(vector<uint8_t>& buf, uint64_t val, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+            buf.push_back((uint8_t)(val >> (8 * i)));
+    }
+
+    bool read_frame(vector<uint8_t>& payload)
+    {
+        uint8_t header[4];
+        if (fread(header, 1, 4, in) != 4)
+            return false;
+
+        // an oversized frame is skipped unread, so the stream stays in step and gets an error
+        uint32_t length = header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24;
+        oversized = length > MAX_REQUEST;
+        if (oversized)
+        {
+            uint8_t skip[4096];
+            for (uint32_t left = length; left > 0;)
+            {
+                size_t got = fread(skip, 1, std::min<size_t>(left, sizeof(skip)), in);
+                if (got == 0)
+                    return false;
+                left -= (uint32_t)got;
+            }
+            payload.clear();
+            return true;
+        }
+
+        payload.resize(length);
+        return fread(payload.data(), 1, length, in) == length;
+    }
+
+    void write_frame()
+    {
+        uint8_t header[4];
+        for (int i = 0; i < 4; ++i)
+            header[i] = (uint8_t)(response.size() >> (8 * i));
+        fwrite(header, 1, 4, out);
+        fwrite(response.data(), 1, response.size(), out);
+        fflush(out);
+    }
+
+    // Executes one request, appending the result to the response. Returns false on QUIT.
+    bool execute(const vector<uint8_t>& payload)
+    {
+        if (payload.empty())
+            throw runtime_error("Empty request");
+
+        // every request is checked whole before it touches any state
+        if (payload[0] > (uint8_t)OPCODE::SET_ISA)
+            throw runtime_error(format("Unknown opcode: {}", payload[0]));
+        if (auto size = REQUEST_SIZE[payload[0]]; size != 0 && payload.size() != size)
+            throw runtime_error(payload.size() < size ? "Truncated request" : "Trailing bytes in request");
+
+        READER r{ payload };
+        switch ((OPCODE)payload[0])
+        {
+            case OPCODE::QUIT:
+                return false;
+
+            case OPCODE::LOAD_ROM:
+            {
+                // checked before the ROM is touched, a rejected request leaves it as it was
+                if ((payload.size() - 1) % 2 != 0)
+                    throw runtime_error("Truncated request");
+                if ((payload.size() - 1) / 2 > INSTRUCTION_COUNT)
+                    throw runtime_error("ROM does not fit in instruction memory");
+
+                mbd->im = {};
+                for (uint16_t i = 0; !r.done(); ++i)
+                    mbd->im[i] = r.u16();
+                rom->decode(mbd->im, mbd->isa);
+                break;
+            }
+
+            case OPCODE::LOAD_RAM:
+            {
+                if (payload.size() < 3)
+                    throw runtime_error("Truncated request");
+                uint32_t address = r.u16();
+                if ((payload.size() - 3) % 2 != 0)
+                    throw runtime_error("Truncated request");
+                if (address + (payload.size() - 3) / 2 > DATA_COUNT)
+                    throw runtime_error("RAM image does not fit in data memory");
+                while (!r.done())
+                    mbd->dm[address++] = bit_cast<int16_t>(r.u16());
+                break;
+            }
+
+            case OPCODE::SET_REGISTERS:
+                mbd->regs.A = bit_cast<int16_t>(r.u16());
+                mbd->regs.D = bit_cast<int16_t>(r.u16());
+                mbd->regs.PC = r.u16();
+                break;
+
+            case OPCODE::GET_REGISTERS:
+                put(response, bit_cast<uint16_t>(mbd->regs.A), 2);
+                put(response, bit_cast<uint16_t>(mbd->regs.D), 2);
+                put(response, mbd->regs.PC, 2);
+                break;
+
+            case OPCODE::RUN:
+            {
+                auto cycles = rom->run(*mbd, r.u64());
+                put(response, cycles, 8);
+                put(response, mbd->regs.PC == TERMINATION_PC_ADDRESS, 1);
+                break;
+            }
+
+            case OPCODE::READ_MEMORY:
+            {
+                uint32_t address = r.u16();
+                uint32_t count = r.u16();
+                if (address + count > DATA_COUNT)
+                    throw runtime_error("Memory range outside data memory");
+                for (uint32_t i = 0; i < count; ++i)
+                    put(response, bit_cast<uint16_t>(mbd->dm[address + i]), 2);
+                break;
+            }
+
+            case OPCODE::SNAPSHOT:
+            {
+                auto id = next_snapshot++;
+                snapshots[id] = make_unique<SNAPSHOT_STATE>(SNAPSHOT_STATE{ mbd->regs, mbd->dm });
+                put(response, id, 4);
+                break;
+            }
+
+            case OPCODE::RESTORE:
+            case OPCODE::DISCARD:
+            {
+                auto it = snapshots.find(r.u32());
+                if (it == snapshots.end())
+                    throw runtime_error("Unknown snapshot");
+
+                if ((OPCODE)payload[0] == OPCODE::RESTORE)
+                {
+                    mbd->regs = it->second->regs;
+                    mbd->dm = it->second->dm;
+                }
+                else
+                    snapshots.erase(it);
+                break;
+            }
+
+            case OPCODE::RESET:
+                mbd->regs = {};
+                mbd->dm = {};
+                break;
+
+            case OPCODE::SET_ISA:
+                mbd->isa = r.get(1) ? ISA::HACKX : ISA::HACK;
+                rom->decode(mbd->im, mbd->isa);
+                break;
+        }
+        return true;
+    }
+
+public:
+    SERVER(FILE* in, FILE* out) : in{ in }, out{ out }
+    {
+        rom->decode(mbd->im, mbd->isa);
+    }
+
+    // Serves requests until QUIT or end of input
+    void serve()
+    {
+        vector<uint8_t> payload;
+        while (read_frame(payload))
+        {
+            response.assign(1, 0);
+            bool keep_going = true;
+            try
+            {
+                if (oversized)
+                    throw runtime_error(format("Request longer than {} bytes", MAX_REQUEST));
+                keep_going = execute(payload);
+            }
+            catch (const std::exception& e)
+            {
+                string what = e.what();
+                response.assign(1, 1);
+                response.insert(response.end(), what.begin(), what.end());
+            }
+
+            write_frame();
+            if (!keep_going)
+                return;
+        }
+    }
+};
@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "Motherboard.h"
+
+// Layout of the named POSIX shared-memory segment exported with --shm. External
+// viewers shm_open the same name read-only, check magic/version and read the
+// Motherboard at motherboard_offset in place. Registers and the cycle counter are
+// published as a seqlock: an odd sequence means an update is in progress, readers
+// retry until they see the same even sequence before and after reading.
+struct SHM_HEADER
+{
+    static constexpr uint32_t MAGIC = 0x4B434148;   // "HACK"
+    static constexpr uint16_t VERSION = 2;
+
+    uint32_t magic = MAGIC;
+    uint16_t version = VERSION;
+    uint16_t data_count = DATA_COUNT;
+    uint32_t motherboard_offset{};
+    uint32_t motherboard_size = sizeof(Motherboard);
+
+    atomic<uint64_t> sequence{};
+    atomic<uint64_t> cycles{};
+    atomic<int16_t> A{};
+    atomic<int16_t> D{};
+    atomic<uint16_t> PC{};
+    atomic<uint8_t> finished{};
+};
+
+static_assert(atomic<uint64_t>::is_always_lock_free && atomic<int16_t>::is_always_lock_free);
+
+class SHARED_MEMORY
+{
+    string name;
+    void* base = MAP_FAILED;
+    size_t size{};
+
+public:
+    SHM_HEADER* header{};
+    Motherboard* mbd{};
+
+    // Creates (or replaces) the segment and constructs a fresh Motherboard inside it.
+    explicit SHARED_MEMORY(string segment_name) : name{ std::move(segment_name) }
+    {
+        if (name.empty() || name[0] != '/')
+            name = "/" + name;
+
+        auto offset = (sizeof(SHM_HEADER) + 63) & ~size_t{ 63 };
+        size = offset + sizeof(Motherboard);
+
+        int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd < 0)
+            throw runtime_error(format("shm_open({}) failed: {}", name, strerror(errno)));
+
+        if (ftruncate(fd, (off_t)size) != 0)
+        {
+            close(fd);
+            throw runtime_error(format("ftruncate({}) failed: {}", name, strerror(errno)));
+        }
+
+        base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+            throw runtime_error(format("mmap({}) failed: {}", name, strerror(errno)));
+
+        mbd = new (static_cast<char*>(base) + offset) Motherboard{};
+        header = new (base) SHM_HEADER{};
+        header->motherboard_offset = (uint32_t)offset;
+    }
+
+    SHARED_MEMORY(const SHARED_MEMORY&) = delete;
+    SHARED_MEMORY& operator=(const SHARED_MEMORY&) = delete;
+
+    void publish(uint64_t cycles, bool finished = false)
+    {
+        auto seq = header->sequence.load(memory_order_relaxed);
+        header->sequence.store(seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+
+        header->cycles.store(cycles, memory_order_relaxed);
+        header->A.store(mbd->regs.A, memory_order_relaxed);
+        header->D.store(mbd->regs.D, memory_order_relaxed);
+        header->PC.store(mbd->regs.PC, memory_order_relaxed);
+        header->finished.store(finished, memory_order_relaxed);
+
+        header->sequence.store(seq + 2, memory_order_release);
+    }
+
+    ~SHARED_MEMORY()
+    {
+        if (base != MAP_FAILED)
+            munmap(base, size);
+        shm_unlink(name.c_str());
+    }
+};
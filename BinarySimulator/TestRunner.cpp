@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TestScript.h"
+
+using namespace std;
+
+// Runs .tst scripts, given directly or found recursively in directories, on parallel
+// workers and prints one line per script in path order.
+
+struct RESULT
+{
+    bool passed = false;
+    string message;
+    vector<string> context;
+    uint64_t cycles = 0;
+    int lines = 0;
+};
+
+static RESULT run_script(const filesystem::path& path, uint64_t max_cycles)
+{
+    RESULT result{};
+    try
+    {
+        TEST_SCRIPT script{ path };
+        script.max_cycles = max_cycles;
+        result.passed = script.run();
+        result.cycles = script.cycles;
+        result.lines = script.output_lines;
+        if (script.failure)
+        {
+            result.message = script.failure->message;
+            result.context = script.failure->context;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        result.message = e.what();
+    }
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = max(thread::hardware_concurrency(), 1u);
+    uint64_t max_cycles = TEST_SCRIPT::DEFAULT_MAX_CYCLES;
+    vector<filesystem::path> scripts;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+            threads = max(stoi(argv[++i]), 1);
+        else if (arg == "--max-cycles" && i + 1 < argc)
+            max_cycles = stoull(argv[++i]);
+        else if (filesystem::is_directory(arg))
+        {
+            for (const auto& entry : filesystem::recursive_directory_iterator(arg))
+                if (entry.is_regular_file() && entry.path().extension() == ".tst")
+                    scripts.push_back(entry.path());
+        }
+        else
+            scripts.push_back(arg);
+    }
+
+    if (scripts.empty())
+    {
+        cerr << "format: ./testrunner.out [--threads N] [--max-cycles N] (script.tst | directory)..." << endl;
+        std::exit(-1);
+    }
+    sort(scripts.begin(), scripts.end());
+
+    auto start = chrono::steady_clock::now();
+    vector<RESULT> results(scripts.size());
+    atomic<size_t> next{ 0 };
+    vector<thread> workers;
+    for (unsigned t = 0; t < min<size_t>(threads, scripts.size()); ++t)
+        workers.emplace_back([&] {
+            for (size_t i; (i = next++) < scripts.size();)
+                results[i] = run_script(scripts[i], max_cycles);
+        });
+    for (auto& worker : workers)
+        worker.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0;
+    for (size_t i = 0; i < scripts.size(); ++i)
+    {
+        const auto& r = results[i];
+        if (r.passed)
+        {
+            cout << format("PASS  {} ({} lines, {} cycles)\n", scripts[i].string(), r.lines, r.cycles);
+            continue;
+        }
+
+        ++failed;
+        cout << format("FAIL  {}\n      {}\n", scripts[i].string(), r.message);
+        for (const auto& line : r.context)
+            cout << "    " << line << "\n";
+    }
+
+    cout << format("\n{} passed, {} failed in {:.2f} s\n", scripts.size() - failed, failed, seconds);
+    return failed == 0 ? 0 : 1;
+}
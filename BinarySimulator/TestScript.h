@@ -0,0 +1,499 @@
+#pragma once
+#include <cctype>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Motherboard.h"
+
+using namespace std;
+
+// Interpreter for nand2tetris CPU emulator test scripts (.tst). Supported commands:
+// load, output-file, compare-to, output-list, output, set, tick, tock, ticktock,
+// repeat N { ... }, while <var> <op> <number> { ... }, echo and clear-echo. Variables are
+// A, D, PC (also ARegister, DRegister), RAM[n], ROM[n] (also RAM16K[n], ROM32K[n]) and time.
+// Every output line is compared against the next line of the compare-to file as it is
+// produced, and the script stops at the first line that differs.
+struct TEST_SCRIPT
+{
+    struct COMMAND
+    {
+        vector<string> words;
+        int line = 0;
+        vector<COMMAND> body;               // repeat and while
+    };
+
+    struct COLUMN
+    {
+        string name;
+        char format = 'D';
+        int left = 1;
+        int width = 6;
+        int right = 1;
+    };
+
+    struct FAILURE
+    {
+        string message;
+        vector<string> context;             // previous matching lines, expected, actual, marker
+    };
+
+    // Runaway while loops and repeats end the script as a failure: max_cycles bounds both the
+    // instructions executed and the loop iterations, a loop body need not tick
+    static constexpr uint64_t DEFAULT_MAX_CYCLES = 100'000'000;
+
+    filesystem::path path;
+    vector<COMMAND> commands;
+    uint64_t max_cycles = DEFAULT_MAX_CYCLES;
+
+    unique_ptr<Motherboard> mbd = make_unique<Motherboard>();
+    uint64_t cycles = 0;
+    uint64_t iterations = 0;                // of repeat and while bodies, over the whole script
+    vector<COLUMN> columns;
+    ofstream output;
+    ifstream compare;
+    int compare_line = 0;
+    int output_lines = 0;
+    deque<string> recent;                   // last matching lines, for the failure context
+    optional<FAILURE> failure;
+
+    static constexpr size_t CONTEXT_LINES = 3;
+
+    explicit TEST_SCRIPT(const filesystem::path& path) : path(path)
+    {
+        ifstream file{ path };
+        if (!file)
+            throw runtime_error(format("Unable to open file: {}", path.string()));
+        stringstream text;
+        text << file.rdbuf();
+
+        auto tokens = tokenize(text.str());
+        size_t next = 0;
+        commands = parse(tokens, next);
+        if (next != tokens.size())
+            throw runtime_error(format("{}:{}: unexpected '}}'", path.string(), tokens[next].line));
+    }
+
+    struct TOKEN
+    {
+        string text;
+        int line;
+    };
+
+    // Words, quoted strings and the separators , ; ! { }
+    static vector<TOKEN> tokenize(const string& text)
+    {
+        vector<TOKEN> tokens;
+        int line = 1;
+        for (size_t i = 0; i < text.size();)
+        {
+            char c = text[i];
+            if (c == '\n')
+                ++line, ++i;
+            else if (isspace((unsigned char)c))
+                ++i;
+            else if (text.compare(i, 2, "//") == 0)
+                i = text.find('\n', i) == string::npos ? text.size() : text.find('\n', i);
+            else if (text.compare(i, 2, "/*") == 0)
+            {
+                auto end = text.find("*/", i + 2);
+                end = end == string::npos ? text.size() : end + 2;
+                line += (int)count(text.begin() + i, text.begin() + end, '\n');
+                i = end;
+            }
+            else if (c == ',' || c == ';' || c == '!' || c == '{' || c == '}')
+                tokens.push_back({ string(1, c), line }), ++i;
+            else if (c == '"')
+            {
+                auto end = text.find('"', i + 1);
+                end = end == string::npos ? text.size() : end;
+                tokens.push_back({ text.substr(i, end - i + 1), line });
+                i = end + 1;
+            }
+            else
+            {
+                auto start = i;
+                while (i < text.size() && !isspace((unsigned char)text[i]) && text.find_first_of(",;!{}", i) != i &&
+                       text.compare(i, 2, "//") != 0 && text.compare(i, 2, "/*") != 0)
+                    ++i;
+                tokens.push_back({ text.substr(start, i - start), line });
+            }
+        }
+        return tokens;
+    }
+
+    static bool is_separator(const string& token) { return token == "," || token == ";" || token == "!"; }
+
+    vector<COMMAND> parse(const vector<TOKEN>& tokens, size_t& next) const
+    {
+        vector<COMMAND> list;
+        while (next < tokens.size() && tokens[next].text != "}")
+        {
+            if (is_separator(tokens[next].text))
+            {
+                ++next;
+                continue;
+            }
+
+            COMMAND command{ {}, tokens[next].line };
+            while (next < tokens.size() && !is_separator(tokens[next].text) && tokens[next].text != "{" &&
+                   tokens[next].text != "}")
+                command.words.push_back(tokens[next++].text);
+
+            if (command.words.empty())
+                throw runtime_error(format("{}:{}: '{{' without a command", path.string(), command.line));
+            if (next < tokens.size() && tokens[next].text == "{")
+            {
+                if (command.words[0] != "repeat" && command.words[0] != "while")
+                    throw runtime_error(format("{}:{}: '{{' after '{}'", path.string(), command.line, command.words[0]));
+                command.body = parse(tokens, ++next);
+                if (next == tokens.size())
+                    throw runtime_error(format("{}:{}: missing '}}'", path.string(), command.line));
+                ++next;
+            }
+            list.push_back(move(command));
+        }
+        return list;
+    }
+
+    [[noreturn]] void error(const COMMAND& command, const string& message) const
+    {
+        throw runtime_error(format("{}:{}: {}", path.string(), command.line, message));
+    }
+
+    // Runs the script; returns false on the first mismatch, see failure
+    bool run()
+    {
+        execute(commands);
+        if (!failure && compare.is_open())
+        {
+            string extra;
+            if (std::getline(compare, extra) && !trim(extra).empty())
+                failure = FAILURE{ format("{} ended after {} output lines, the compare file has more", path.filename().string(),
+                                          output_lines), { "  expected: " + trim(extra) } };
+        }
+        return !failure;
+    }
+
+    bool execute(const vector<COMMAND>& list)
+    {
+        for (const auto& command : list)
+            if (!execute(command))
+                return false;
+        return true;
+    }
+
+    bool execute(const COMMAND& command)
+    {
+        const auto& w = command.words;
+        const auto& name = w[0];
+        auto directory = path.parent_path();
+
+        if (name == "load" && w.size() == 2)
+        {
+            auto rom = directory / w[1];
+            if (rom.extension() != ".hack")
+                error(command, format("only .hack programs can be loaded: {}", w[1]));
+            mbd = make_unique<Motherboard>();
+            cycles = 0;
+            load_binary_file(rom.string(), [&](size_t index, uint16_t val) {
+                mbd->im[index] = val;
+            }, rom_image_flags(mbd->isa));
+        }
+        else if (name == "output-file" && w.size() == 2)
+        {
+            output.open(directory / w[1]);
+            if (!output)
+                error(command, format("unable to open {}", w[1]));
+        }
+        else if (name == "compare-to" && w.size() == 2)
+        {
+            compare.open(directory / w[1]);
+            if (!compare)
+                error(command, format("unable to open {}", w[1]));
+        }
+        else if (name == "output-list")
+        {
+            columns.clear();
+            for (size_t i = 1; i < w.size(); ++i)
+                columns.push_back(parse_column(command, w[i]));
+            return emit(header());
+        }
+        else if (name == "output" && w.size() == 1)
+            return emit(row());
+        else if (name == "set" && w.size() == 3)
+            set(command, w[1], parse_value(command, w[2]));
+        else if ((name == "tick" || name == "ticktock") && w.size() == 1)
+            return tick(command);
+        else if ((name == "tock" || name == "echo" || name == "clear-echo" || name == "breakpoint" ||
+                  name == "clear-breakpoints"))
+            return true;
+        else if (name == "repeat" && w.size() <= 2)
+        {
+            long long count = w.size() == 2 ? stoll(w[1]) : -1;
+            for (long long i = 0; count < 0 || i < count; ++i)
+                if (!iterate(command) || !execute(command.body))
+                    return false;
+        }
+        else if (name == "while" && w.size() == 4)
+        {
+            auto bound = parse_value(command, w[3]);
+            while (holds(command, get(command, w[1]), w[2], bound))
+                if (!iterate(command) || !execute(command.body))
+                    return false;
+        }
+        else
+            error(command, format("invalid command '{}'", name));
+        return true;
+    }
+
+    // Counts one pass through a loop body against max_cycles
+    bool iterate(const COMMAND& command)
+    {
+        if (iterations++ >= max_cycles)
+        {
+            failure = FAILURE{ format("{}:{}: exceeded {} loop iterations", path.filename().string(), command.line,
+                                      max_cycles), {} };
+            return false;
+        }
+        return true;
+    }
+
+    bool tick(const COMMAND& command)
+    {
+        if (cycles >= max_cycles)
+        {
+            failure = FAILURE{ format("{}:{}: exceeded {} cycles", path.filename().string(), command.line, max_cycles), {} };
+            return false;
+        }
+        if (mbd->regs.PC == TERMINATION_PC_ADDRESS)
+            return true;
+
+        try
+        {
+            ++mbd->begin();
+        }
+        catch (const exception& e)
+        {
+            failure = FAILURE{ format("{}:{}: {} at cycle {}", path.filename().string(), command.line, e.what(), cycles), {} };
+            return false;
+        }
+        ++cycles;
+        return true;
+    }
+
+    static bool holds(const COMMAND& command, int32_t value, const string& op, int32_t bound)
+    {
+        if (op == "=")
+            return value == bound;
+        if (op == "<>")
+            return value != bound;
+        if (op == "<")
+            return value < bound;
+        if (op == ">")
+            return value > bound;
+        if (op == "<=")
+            return value <= bound;
+        if (op == ">=")
+            return value >= bound;
+        throw runtime_error(format("line {}: invalid comparison '{}'", command.line, op));
+    }
+
+    // Number, or %D / %X / %B followed by digits
+    int32_t parse_value(const COMMAND& command, const string& text) const
+    {
+        try
+        {
+            if (text.size() > 2 && text[0] == '%')
+            {
+                auto digits = text.substr(2);
+                switch (toupper(text[1]))
+                {
+                case 'D':
+                    return stoi(digits);
+                case 'X':
+                    return bit_cast<int16_t>((uint16_t)stoul(digits, nullptr, 16));
+                case 'B':
+                    return bit_cast<int16_t>((uint16_t)stoul(digits, nullptr, 2));
+                }
+            }
+            return stoi(text);
+        }
+        catch (const logic_error&)
+        {
+            error(command, format("invalid value '{}'", text));
+        }
+    }
+
+    // RAM[n] style variables; returns nullopt for the registers and time
+    optional<uint32_t> index_of(const COMMAND& command, const string& var, const string& memory) const
+    {
+        auto names = memory == "RAM" ? vector<string>{ "RAM[", "RAM16K[" } : vector<string>{ "ROM[", "ROM32K[" };
+        for (const auto& prefix : names)
+            if (var.starts_with(prefix) && var.ends_with("]"))
+            {
+                auto index = stoul(var.substr(prefix.size(), var.size() - prefix.size() - 1));
+                if (index >= (memory == "RAM" ? DATA_COUNT : INSTRUCTION_COUNT))
+                    error(command, format("{} out of range", var));
+                return (uint32_t)index;
+            }
+        return nullopt;
+    }
+
+    int32_t get(const COMMAND& command, const string& var) const
+    {
+        if (var == "A" || var == "ARegister")
+            return mbd->regs.A;
+        if (var == "D" || var == "DRegister")
+            return mbd->regs.D;
+        if (var == "PC")
+            return mbd->regs.PC;
+        if (var == "time")
+            return (int32_t)cycles;
+        if (auto index = index_of(command, var, "RAM"))
+            return mbd->dm[*index];
+        if (auto index = index_of(command, var, "ROM"))
+            return bit_cast<int16_t>(mbd->im[*index]);
+        error(command, format("unknown variable '{}'", var));
+    }
+
+    void set(const COMMAND& command, const string& var, int32_t value)
+    {
+        if (var == "A" || var == "ARegister")
+            mbd->regs.A = (int16_t)value;
+        else if (var == "D" || var == "DRegister")
+            mbd->regs.D = (int16_t)value;
+        else if (var == "PC")
+            mbd->regs.PC = (uint16_t)value;
+        else if (auto index = index_of(command, var, "RAM"))
+            mbd->dm[*index] = (int16_t)value;
+        else if (auto index = index_of(command, var, "ROM"))
+            mbd->im[*index] = (uint16_t)value;
+        else
+            error(command, format("unknown variable '{}'", var));
+    }
+
+    // name%F.L.N.R, the format defaulting to %D1.6.1
+    COLUMN parse_column(const COMMAND& command, const string& spec) const
+    {
+        COLUMN column{};
+        auto percent = spec.find('%');
+        column.name = spec.substr(0, percent);
+        if (percent == string::npos)
+            return column;
+
+        char dot;
+        stringstream sstr{ spec.substr(percent + 2) };
+        column.format = (char)toupper(spec[percent + 1]);
+        if (string("BXDS").find(column.format) == string::npos ||
+            !(sstr >> column.left >> dot >> column.width >> dot >> column.right) ||
+            column.left < 0 || column.width < 0 || column.right < 0)
+            error(command, format("invalid output format '{}'", spec));
+        return column;
+    }
+
+    string header() const
+    {
+        string line = "|";
+        for (const auto& c : columns)
+        {
+            int total = c.left + c.width + c.right;
+            auto name = c.name.substr(0, total);
+            int pad = total - (int)name.size();
+            line += string(pad / 2, ' ') + name + string(pad - pad / 2, ' ') + "|";
+        }
+        return line;
+    }
+
+    string format_value(const COLUMN& c, int32_t value) const
+    {
+        string text;
+        switch (c.format)
+        {
+        case 'B':
+            text = format("{:016b}", (uint16_t)value);
+            break;
+        case 'X':
+            text = format("{:04X}", (uint16_t)value);
+            break;
+        default:
+            text = to_string(value);
+            break;
+        }
+
+        if ((int)text.size() > c.width)
+            text = text.substr(text.size() - c.width);
+        else if (c.format == 'S')
+            text += string(c.width - text.size(), ' ');
+        else
+            text = string(c.width - text.size(), ' ') + text;
+        return string(c.left, ' ') + text + string(c.right, ' ');
+    }
+
+    string row() const
+    {
+        string line = "|";
+        for (const auto& c : columns)
+        {
+            COMMAND none{ { c.name } };
+            line += format_value(c, get(none, c.name)) + "|";
+        }
+        return line;
+    }
+
+    static string trim(string line)
+    {
+        while (!line.empty() && isspace((unsigned char)line.back()))
+            line.pop_back();
+        return line;
+    }
+
+    // Writes the line to the output file and checks it against the compare file
+    bool emit(const string& line)
+    {
+        ++output_lines;
+        if (output.is_open())
+            output << line << "\n";
+        if (!compare.is_open())
+            return true;
+
+        string expected;
+        ++compare_line;
+        if (!std::getline(compare, expected))
+        {
+            failure = FAILURE{ format("{}: output line {} is past the end of the compare file", path.filename().string(),
+                                      output_lines), { "  actual:   " + line } };
+            return false;
+        }
+
+        expected = trim(expected);
+        if (expected == trim(line))
+        {
+            recent.push_back(line);
+            if (recent.size() > CONTEXT_LINES)
+                recent.pop_front();
+            return true;
+        }
+
+        FAILURE f{ format("{}: comparison failure at line {} after {} cycles", path.filename().string(), compare_line, cycles),
+                   {} };
+        for (const auto& previous : recent)
+            f.context.push_back("            " + previous);
+        f.context.push_back("  expected: " + expected);
+        f.context.push_back("  actual:   " + line);
+
+        string marker(line.size(), ' ');
+        for (size_t i = 0; i < line.size(); ++i)
+            if (i >= expected.size() || expected[i] != line[i])
+                marker[i] = '^';
+        f.context.push_back("            " + trim(marker));
+        failure = move(f);
+        return false;
+    }
+};
@@ -0,0 +1,155 @@
+#pragma once
+#include <algorithm>
+#include <format>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include "Instrumentation.h"
+
+using namespace std;
+
+// An analysis built on the instrumentation API. New tools only need an entry in TOOLS.
+struct TOOL
+{
+    virtual ~TOOL() = default;
+    virtual void attach(INSTRUMENTATION& instrumentation) = 0;
+    virtual void report(ostream& out) const = 0;
+};
+
+// Writes to a data range, per writing instruction. Defaults to THIS and THAT.
+struct WRITES_TOOL : TOOL
+{
+    INSTRUMENTATION::RANGE range{ 3, 5 };
+    map<uint16_t, uint64_t> by_pc;
+    map<uint16_t, uint64_t> by_address;
+
+    explicit WRITES_TOOL(const vector<uint32_t>& args)
+    {
+        if (args.size() >= 1)
+            range = { args[0], args.size() >= 2 ? args[1] : args[0] + 1 };
+    }
+
+    void attach(INSTRUMENTATION& instrumentation) override
+    {
+        instrumentation.on_write([this](const Motherboard&, uint16_t pc, uint16_t address) {
+            ++by_pc[pc];
+            ++by_address[address];
+        }, range);
+    }
+
+    void report(ostream& out) const override
+    {
+        out << format("Writes to {}-{}:\n", range.from, range.to - 1);
+        for (const auto& [address, count] : by_address)
+            out << format("  RAM {:5}: {}\n", address, count);
+        out << "By instruction:\n";
+        for (const auto& [pc, count] : by_pc)
+            out << format("  ROM {:5}: {}\n", pc, count);
+    }
+};
+
+// Arguments of every call reaching a ROM address, read through ARG as the VM call sequence
+// leaves it at the function label, e.g. the size passed to Memory.alloc.
+struct ARGS_TOOL : TOOL
+{
+    uint16_t address;
+    uint16_t count = 1;
+    vector<vector<int16_t>> calls;
+
+    explicit ARGS_TOOL(const vector<uint32_t>& args)
+    {
+        if (args.empty() || args.size() > 2)
+            throw runtime_error("args tool: expected args:<ROM address>[:<argument count>]");
+        address = (uint16_t)args[0];
+        if (args.size() == 2)
+            count = (uint16_t)args[1];
+    }
+
+    void attach(INSTRUMENTATION& instrumentation) override
+    {
+        instrumentation.on_pc_range(address, address + 1, [this](const Motherboard& mbd, uint16_t) {
+            vector<int16_t> values;
+            for (uint16_t i = 0; i < count; ++i)
+            {
+                auto word = mbd.dm.word((uint16_t)(bit_cast<uint16_t>(mbd.dm.ram[2]) + i));
+                values.push_back(word ? *word : 0);
+            }
+            calls.push_back(move(values));
+        });
+    }
+
+    void report(ostream& out) const override
+    {
+        out << format("Calls to ROM {}: {}\n", address, calls.size());
+        for (size_t i = 0; i < calls.size(); ++i)
+        {
+            out << format("  #{}:", i + 1);
+            for (auto value : calls[i])
+                out << " " << value;
+            out << "\n";
+        }
+    }
+};
+
+// Executions per basic block, most frequent first
+struct BLOCKS_TOOL : TOOL
+{
+    size_t top = 20;
+    map<uint16_t, uint64_t> counts;
+
+    explicit BLOCKS_TOOL(const vector<uint32_t>& args)
+    {
+        if (!args.empty())
+            top = args[0];
+    }
+
+    void attach(INSTRUMENTATION& instrumentation) override
+    {
+        instrumentation.on_block([this](const Motherboard&, uint16_t pc) { ++counts[pc]; });
+    }
+
+    void report(ostream& out) const override
+    {
+        vector<pair<uint64_t, uint16_t>> blocks;
+        for (const auto& [pc, count] : counts)
+            blocks.push_back({ count, pc });
+        sort(blocks.rbegin(), blocks.rend());
+
+        out << format("Basic blocks: {} distinct\n", blocks.size());
+        for (size_t i = 0; i < min(top, blocks.size()); ++i)
+            out << format("  ROM {:5}: {}\n", blocks[i].second, blocks[i].first);
+    }
+};
+
+struct TOOL_TYPE
+{
+    const char* name;
+    unique_ptr<TOOL> (*create)(const vector<uint32_t>& args);
+};
+
+const TOOL_TYPE TOOLS[] = {
+    { "writes", [](const vector<uint32_t>& args) -> unique_ptr<TOOL> { return make_unique<WRITES_TOOL>(args); } },
+    { "args", [](const vector<uint32_t>& args) -> unique_ptr<TOOL> { return make_unique<ARGS_TOOL>(args); } },
+    { "blocks", [](const vector<uint32_t>& args) -> unique_ptr<TOOL> { return make_unique<BLOCKS_TOOL>(args); } },
+};
+
+// Spec format: name[:number]...
+inline unique_ptr<TOOL> make_tool(const string& spec)
+{
+    stringstream sstr{ spec };
+    string name;
+    std::getline(sstr, name, ':');
+
+    vector<uint32_t> args;
+    for (string part; std::getline(sstr, part, ':');)
+        args.push_back((uint32_t)stoul(part));
+
+    for (const auto& type : TOOLS)
+        if (name == type.name)
+            return type.create(args);
+
+    throw runtime_error(format("Unknown tool: '{}'", spec));
+}
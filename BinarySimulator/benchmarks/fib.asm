@@ -0,0 +1,228 @@
+// Recursive Fibonacci through the VM calling convention used by
+// VMTranslator: every call saves LCL/ARG/THIS/THAT and every return
+// restores them. Computes fib(20) into RAM[256].
+  @256  // SP = 256
+  D = A
+  @SP
+  M = D
+
+  @20  // push constant 20
+  D = A
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+
+  // call Fib.fib 1
+  @MAIN_RET  // push MAIN_RET
+  D = A
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @LCL  // push LCL
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @ARG  // push ARG
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @THIS  // push THIS
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @THAT  // push THAT
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @SP  // LCL = SP
+  D = M
+  @LCL
+  M = D
+  @6  // ARG = SP - 5 - nArgs
+  D = D - A
+  @ARG
+  M = D
+  @Fib.fib
+  0; JMP
+(MAIN_RET)
+  A = -1
+  0; JMP
+
+  // function Fib.fib 0
+(Fib.fib)
+  @ARG  // if n < 2 return n
+  A = M
+  D = M
+  @2
+  D = D - A
+  @FIB_RECURSE
+  D; JGE
+  @ARG  // push argument 0
+  A = M
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @FIB_RETURN
+  0; JMP
+
+(FIB_RECURSE)
+  @ARG  // push n - 1
+  A = M
+  D = M - 1
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  // call Fib.fib 1
+  @FIB_RET_1  // push FIB_RET_1
+  D = A
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @LCL  // push LCL
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @ARG  // push ARG
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @THIS  // push THIS
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @THAT  // push THAT
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @SP  // LCL = SP
+  D = M
+  @LCL
+  M = D
+  @6  // ARG = SP - 5 - nArgs
+  D = D - A
+  @ARG
+  M = D
+  @Fib.fib
+  0; JMP
+(FIB_RET_1)
+
+  @ARG  // push n - 2
+  A = M
+  D = M
+  @2
+  D = D - A
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  // call Fib.fib 1
+  @FIB_RET_2  // push FIB_RET_2
+  D = A
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @LCL  // push LCL
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @ARG  // push ARG
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @THIS  // push THIS
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @THAT  // push THAT
+  D = M
+  @SP
+  AM = M + 1
+  A = A - 1
+  M = D
+  @SP  // LCL = SP
+  D = M
+  @LCL
+  M = D
+  @6  // ARG = SP - 5 - nArgs
+  D = D - A
+  @ARG
+  M = D
+  @Fib.fib
+  0; JMP
+(FIB_RET_2)
+
+  @SP  // add
+  AM = M - 1
+  D = M
+  A = A - 1
+  M = D + M
+
+(FIB_RETURN)
+  @SP  // MEM[ARG] <- MEM[SP - 1]
+  A = M - 1
+  D = M
+  @ARG
+  A = M
+  M = D
+  D = A + 1  // SP = ARG + 1
+  @SP
+  M = D
+  @LCL  // R15 <- return address
+  D = M
+  @5
+  A = D - A
+  D = M
+  @R15
+  M = D
+  @LCL  // pop THAT using LCL
+  AM = M - 1
+  D = M
+  @THAT
+  M = D
+  @LCL  // pop THIS using LCL
+  AM = M - 1
+  D = M
+  @THIS
+  M = D
+  @LCL  // pop ARG using LCL
+  AM = M - 1
+  D = M
+  @ARG
+  M = D
+  @LCL  // pop LCL using LCL
+  AM = M - 1
+  D = M
+  @LCL
+  M = D
+  @R15  // jump to return address
+  A = M
+  0; JMP
@@ -0,0 +1,30 @@
+// Screen fill: inverts every word of the screen map, 20 passes.
+  @20
+  D = A
+  @pass
+  M = D
+
+(PASS)
+  @SCREEN
+  D = A
+  @addr
+  M = D
+
+(FILL)
+  @addr  // RAM[addr] = !RAM[addr]
+  A = M
+  M = !M
+  @addr
+  MD = M + 1
+  @KBD
+  D = D - A
+  @FILL
+  D; JLT
+
+  @pass
+  MD = M - 1
+  @PASS
+  D; JGT
+
+  A = -1
+  0; JMP
@@ -0,0 +1,32 @@
+// Multiplication by repeated addition, the way Math.multiply runs on an ALU
+// without shift or multiply. Computes i * 123 for i = 1000 down to 1.
+  @1000
+  D = A
+  @i
+  M = D
+
+(OUTER)
+  @123
+  D = A
+  @j
+  M = D
+  @prod
+  M = 0
+
+(INNER)
+  @i  // prod += i
+  D = M
+  @prod
+  M = D + M
+  @j
+  MD = M - 1
+  @INNER
+  D; JGT
+
+  @i
+  MD = M - 1
+  @OUTER
+  D; JGT
+
+  A = -1
+  0; JMP
@@ -0,0 +1,98 @@
+// Bubble sort of 300 words stored at RAM[1024], initialised in descending
+// order so that every comparison swaps.
+  @300
+  D = A
+  @n
+  M = D
+  @k
+  M = 0
+
+(INIT)
+  @k  // R13 <- n - k
+  D = M
+  @n
+  D = M - D
+  @INIT_DONE
+  D; JLE
+  @R13
+  M = D
+  @k  // R14 <- 1024 + k
+  D = M
+  @1024
+  D = D + A
+  @R14
+  M = D
+  @R13  // RAM[R14] <- R13
+  D = M
+  @R14
+  A = M
+  M = D
+  @k
+  M = M + 1
+  @INIT
+  0; JMP
+(INIT_DONE)
+
+  @n  // end = n - 1
+  D = M - 1
+  @end
+  M = D
+
+(OUTER)
+  @end
+  D = M
+  @SORT_DONE
+  D; JLE
+  @1024  // p = 1024, last = 1024 + end
+  D = A
+  @p
+  M = D
+  @end
+  D = D + M
+  @last
+  M = D
+
+(INNER)
+  @p
+  D = M
+  @last
+  D = D - M
+  @INNER_DONE
+  D; JGE
+  @p  // D = RAM[p] - RAM[p + 1]
+  A = M
+  D = M
+  A = A + 1
+  D = D - M
+  @NO_SWAP
+  D; JLE
+  @p  // R13 <- RAM[p]
+  A = M
+  D = M
+  @R13
+  M = D
+  @p  // RAM[p] <- RAM[p + 1]
+  A = M + 1
+  D = M
+  A = A - 1
+  M = D
+  @R13  // RAM[p + 1] <- R13
+  D = M
+  @p
+  A = M + 1
+  M = D
+(NO_SWAP)
+  @p
+  M = M + 1
+  @INNER
+  0; JMP
+(INNER_DONE)
+
+  @end
+  M = M - 1
+  @OUTER
+  0; JMP
+
+(SORT_DONE)
+  A = -1
+  0; JMP
@@ -0,0 +1,134 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Source buffer shared by the assembler, VM translator and compiler front ends. A regular
+// file is mapped whole, anything else (a pipe, /dev/stdin) is read in one pass, so the
+// lexers see the input as one contiguous array. Reads past the end yield '\0', the end
+// marker the DFAs stop on.
+class Buffer
+{
+private:
+	static constexpr char END = '\0';
+	static constexpr size_t READ_BLOCK = 1 << 16;
+
+	const char* data = nullptr;
+	int length = 0;
+	void* mapping = nullptr;
+	size_t mapped = 0;
+	std::vector<char> contents;
+
+	void readAll(int fd)
+	{
+		size_t used = 0;
+		while (true)
+		{
+			contents.resize(used + READ_BLOCK);
+			ssize_t got = read(fd, contents.data() + used, READ_BLOCK);
+			if (got <= 0)
+				break;
+			used += got;
+		}
+		contents.resize(used);
+		data = contents.data();
+		length = (int)used;
+	}
+
+public:
+	int line_number = 1;
+	int start_index = 0;
+	std::string file_name;
+
+	Buffer(const char* fileLoc)
+	{
+		int fd = open(fileLoc, O_RDONLY);
+		if (fd < 0)
+		{
+			std::cerr << "Cannot open " << fileLoc << ": " << strerror(errno) << std::endl;
+			std::exit(-1);
+		}
+
+		struct stat info{};
+		if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+		{
+			mapped = (size_t)info.st_size;
+			mapping = mmap(nullptr, mapped, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping == MAP_FAILED)
+				mapping = nullptr;
+			else
+			{
+				madvise(mapping, mapped, MADV_SEQUENTIAL);
+				data = (const char*)mapping;
+				length = (int)mapped;
+			}
+		}
+		if (mapping == nullptr)
+			readAll(fd);
+		close(fd);
+
+		file_name = std::string(fileLoc);
+		file_name = file_name.substr(file_name.find_last_of("/\\") + 1);
+		file_name = file_name.substr(0, file_name.find_last_of("/."));
+	}
+
+	// A window on text owned elsewhere, with lines counted from first_line
+	Buffer(std::string_view text, int first_line) : data{ text.data() }, length{ (int)text.size() }, line_number{ first_line }
+	{
+	}
+
+	Buffer(const Buffer&) = delete;
+	Buffer& operator=(const Buffer&) = delete;
+
+	const char& getChar(int index) const
+	{
+		if (index == -1)
+			index = start_index;
+		return index < length ? data[index] : END;
+	}
+
+	const char& getTopChar() const
+	{
+		return getChar(start_index);
+	}
+
+	// Characters [index, index + count), clipped to the input
+	std::string_view view(int index, int count) const
+	{
+		index = std::min(index, length);
+		return { data + index, (size_t)std::min(count, length - index) };
+	}
+
+	std::string_view text() const
+	{
+		return { data, (size_t)length };
+	}
+
+	int size() const
+	{
+		return length;
+	}
+
+	// Consumes count characters at start_index, keeping line_number in step
+	void advance(int count)
+	{
+		auto consumed = view(start_index, count);
+		line_number += (int)std::count(consumed.begin(), consumed.end(), '\n');
+		start_index += count;
+	}
+
+	~Buffer()
+	{
+		if (mapping != nullptr)
+			munmap(mapping, mapped);
+	}
+};
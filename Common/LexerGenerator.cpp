@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Compiles a front end's DFA.txt into the tables its lexer runs on, written as a C++ header.
+// Run by the build for every front end:
+//   ./lexergenerator.out DFA.txt DFA.h
+// Bytes are folded into character classes, bytes every state treats alike share one, so the
+// transition table is states x classes of bytes. Keywords go into a perfect hash table.
+
+[[noreturn]] static void fail(const string& file, const string& message)
+{
+    cerr << file << ": " << message << endl;
+    exit(-1);
+}
+
+// The bytes of a char stream: \s space, \t, \r, \n, \\ and \* for every byte but NUL
+static vector<unsigned char> parse_stream(const string& stream, const string& file)
+{
+    vector<unsigned char> bytes;
+    for (size_t i = 0; i < stream.size(); ++i)
+    {
+        if (stream[i] != '\\')
+        {
+            bytes.push_back(stream[i]);
+            continue;
+        }
+        if (++i == stream.size())
+            fail(file, "char stream '" + stream + "' ends in a backslash");
+
+        switch (stream[i])
+        {
+        case 's': bytes.push_back(' '); break;
+        case 't': bytes.push_back('\t'); break;
+        case 'r': bytes.push_back('\r'); break;
+        case 'n': bytes.push_back('\n'); break;
+        case '\\': bytes.push_back('\\'); break;
+        case '*':
+            for (int c = 1; c < 256; ++c)
+                bytes.push_back(c);
+            break;
+        default: fail(file, "unknown escape in char stream '" + stream + "'");
+        }
+    }
+    return bytes;
+}
+
+// FNV-1a, the lookup written out below hashes the same way
+static uint32_t keyword_hash(string_view text)
+{
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : text)
+        hash = (hash ^ c) * 16777619u;
+    return hash;
+}
+
+static int keyword_slot(uint32_t hash, uint32_t multiplier, int bits)
+{
+    return (int)((hash * multiplier) >> (32 - bits));
+}
+
+static string quoted(string_view text)
+{
+    string out = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out.push_back('\\');
+        out.push_back(c);
+    }
+    return out + "\"";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        cerr << "Usage: ./lexergenerator.out <DFA file> <output_header_location>" << endl;
+        exit(-1);
+    }
+
+    string file = argv[1];
+    ifstream in{ file };
+    if (!in)
+        fail(file, "cannot open");
+
+    int num_tokens, num_states, num_transitions, num_final_states, num_keywords;
+    if (!(in >> num_tokens >> num_states >> num_transitions >> num_final_states >> num_keywords))
+        fail(file, "missing counts");
+    if (num_states < 1 || num_states > 127)
+        fail(file, "the tables hold 1-127 states");
+
+    vector<string> tokens(num_tokens);
+    map<string, int> token_id;
+    for (int i = 0; i < num_tokens; ++i)
+    {
+        in >> tokens[i];
+        token_id[tokens[i]] = i;
+    }
+    auto token_of = [&](const string& name) {
+        if (token_id.find(name) == token_id.end())
+            fail(file, "unknown token " + name);
+        return name;
+    };
+
+    // later transitions override earlier ones, an end state of -1 removes one
+    vector<array<int, 256>> next(num_states);
+    for (auto& row : next)
+        row.fill(-1);
+    for (int i = 0; i < num_transitions; ++i)
+    {
+        int from, to;
+        string stream;
+        if (!(in >> from >> to >> stream))
+            fail(file, "missing transition " + to_string(i + 1));
+        if (from < 0 || from >= num_states || to < -1 || to >= num_states)
+            fail(file, "transition " + to_string(i + 1) + " is out of range");
+        for (unsigned char c : parse_stream(stream, file))
+            next[from][c] = to;
+    }
+
+    // NUL ends the input, it never continues a token
+    for (auto& row : next)
+        row[0] = -1;
+
+    vector<string> final_states(num_states, "UNINITIALISED");
+    for (int i = 0; i < num_final_states; ++i)
+    {
+        int state;
+        string token;
+        if (!(in >> state >> token) || state < 0 || state >= num_states)
+            fail(file, "bad final state " + to_string(i + 1));
+        final_states[state] = token_of(token);
+    }
+
+    vector<pair<string, string>> keywords;
+    set<string> keyword_tokens;
+    for (int i = 0; i < num_keywords; ++i)
+    {
+        string keyword, token;
+        if (!(in >> keyword >> token))
+            fail(file, "missing keyword " + to_string(i + 1));
+        keywords.push_back({ keyword, token_of(token) });
+        keyword_tokens.insert(token);
+    }
+
+    // character classes, numbered in order of their first byte
+    array<int, 256> char_class{};
+    vector<int> representative;
+    for (int c = 0; c < 256; ++c)
+    {
+        int k = 0;
+        for (; k < (int)representative.size(); ++k)
+            if (all_of(next.begin(), next.end(), [&](auto& row) { return row[c] == row[representative[k]]; }))
+                break;
+        if (k == (int)representative.size())
+            representative.push_back(c);
+        char_class[c] = k;
+    }
+
+    // the smallest table, and the first multiplier for it, without collisions
+    int bits = 1;
+    uint32_t multiplier = 0x9E3779B1u;
+    size_t max_keyword = 0;
+    for (auto& keyword : keywords)
+        max_keyword = max(max_keyword, keyword.first.size());
+    for (bool perfect = false; !perfect;)
+    {
+        while ((1u << bits) < keywords.size())
+            ++bits;
+        multiplier = 0x9E3779B1u;
+        for (int attempt = 0; attempt < 100000 && !perfect; ++attempt)
+        {
+            vector<bool> used(1 << bits);
+            perfect = true;
+            for (auto& keyword : keywords)
+            {
+                int slot = keyword_slot(keyword_hash(keyword.first), multiplier, bits);
+                perfect = perfect && !used[slot];
+                used[slot] = true;
+            }
+            if (!perfect)
+                multiplier = (multiplier * 747796405u + 2891336453u) | 1;
+        }
+        if (!perfect)
+            ++bits;
+    }
+    vector<const pair<string, string>*> slots(1 << bits);
+    for (auto& keyword : keywords)
+        slots[keyword_slot(keyword_hash(keyword.first), multiplier, bits)] = &keyword;
+
+    ostringstream out;
+    out << "// Generated from " << file << " by LexerGenerator.out, do not edit\n"
+        << "#pragma once\n"
+        << "#include <array>\n"
+        << "#include <cstdint>\n"
+        << "#include <string_view>\n\n";
+
+    out << "// TokenType has to list the tokens of the DFA in the same order\n";
+    for (int i = 0; i < num_tokens; ++i)
+        out << "static_assert((int)TokenType::" << tokens[i] << " == " << i << ");\n";
+
+    out << "\nconstexpr int DFA_STATES = " << num_states << ";\n"
+        << "constexpr int DFA_CLASSES = " << representative.size() << ";\n\n";
+
+    out << "// byte -> character class\n"
+        << "constexpr uint8_t DFA_CHAR_CLASS[256] = {";
+    for (int c = 0; c < 256; ++c)
+        out << (c % 16 == 0 ? "\n    " : " ") << char_class[c] << ",";
+    out << "\n};\n\n";
+
+    out << "// state, character class -> next state, -1 ends the token\n"
+        << "constexpr int8_t DFA_NEXT[DFA_STATES][DFA_CLASSES] = {\n";
+    for (auto& row : next)
+    {
+        out << "    {";
+        for (int k = 0; k < (int)representative.size(); ++k)
+            out << (k == 0 ? " " : ", ") << row[representative[k]];
+        out << " },\n";
+    }
+    out << "};\n\n";
+
+    out << "// state -> token it accepts, UNINITIALISED if none\n"
+        << "constexpr TokenType DFA_FINAL[DFA_STATES] = {\n";
+    for (auto& token : final_states)
+        out << "    TokenType::" << token << ",\n";
+    out << "};\n\n";
+
+    out << "constexpr std::array<std::string_view, " << tokens.size() << "> DFA_TOKEN_NAMES = {\n";
+    for (auto& token : tokens)
+        out << "    " << quoted(token) << ",\n";
+    out << "};\n\n";
+
+    out << "// tokens that keywords map to\n"
+        << "constexpr std::array<std::string_view, " << keyword_tokens.size() << "> DFA_KEYWORD_TOKENS = {\n";
+    for (auto& token : keyword_tokens)
+        out << "    " << quoted(token) << ",\n";
+    out << "};\n\n";
+
+    out << "struct DFA_KEYWORD\n"
+        << "{\n"
+        << "    std::string_view text;          // empty for an unused slot\n"
+        << "    TokenType type;\n"
+        << "};\n\n"
+        << "constexpr int DFA_KEYWORD_BITS = " << bits << ";\n"
+        << "constexpr uint32_t DFA_KEYWORD_MULTIPLIER = 0x" << hex << uppercase << multiplier << dec << "u;\n"
+        << "constexpr size_t DFA_MAX_KEYWORD = " << max_keyword << ";\n\n"
+        << "constexpr DFA_KEYWORD DFA_KEYWORDS[1 << DFA_KEYWORD_BITS] = {\n";
+    for (auto* slot : slots)
+        if (slot == nullptr)
+            out << "    { {}, TokenType::UNINITIALISED },\n";
+        else
+            out << "    { " << quoted(slot->first) << ", TokenType::" << slot->second << " },\n";
+    out << "};\n\n";
+
+    out << "// The token of a keyword, UNINITIALISED for any other text\n"
+        << "inline TokenType lookupKeyword(std::string_view text)\n"
+        << "{\n"
+        << "    if (text.empty() || text.size() > DFA_MAX_KEYWORD)\n"
+        << "        return TokenType::UNINITIALISED;\n\n"
+        << "    uint32_t hash = 2166136261u;\n"
+        << "    for (unsigned char c : text)\n"
+        << "        hash = (hash ^ c) * 16777619u;\n"
+        << "    const DFA_KEYWORD& keyword = DFA_KEYWORDS[(hash * DFA_KEYWORD_MULTIPLIER) >> (32 - DFA_KEYWORD_BITS)];\n"
+        << "    return keyword.text == text ? keyword.type : TokenType::UNINITIALISED;\n"
+        << "}\n";
+
+    ofstream header{ argv[2] };
+    header << out.str();
+    if (!header)
+        fail(argv[2], "cannot write");
+}
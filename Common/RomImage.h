@@ -0,0 +1,52 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+
+// ROM image written by `assembler.out --format=image` and mapped by the simulator. Sections
+// follow the header, each 8-byte aligned, so a reader can use them in place:
+//   header | words: u16 per ROM word | symbols | names: NUL-terminated | lines: u32 per ROM word
+// The line map gives the 1-based source line of every word, 0 for words that have none
+// (far-jump stubs, gaps between banks).
+
+static_assert(std::endian::native == std::endian::little, "ROM images are stored in host byte order");
+
+constexpr char ROM_IMAGE_MAGIC[8] = { 'H', 'A', 'C', 'K', 'R', 'O', 'M', '\0' };
+constexpr uint32_t ROM_IMAGE_VERSION = 1;
+
+enum ROM_IMAGE_FLAG : uint32_t
+{
+    ROM_IMAGE_HACKX = 1,
+    ROM_IMAGE_BANKED = 2,
+};
+
+enum ROM_IMAGE_SYMBOL_KIND : uint16_t
+{
+    ROM_IMAGE_LABEL = 0,        // value is a ROM address
+    ROM_IMAGE_VARIABLE = 1,     // value is a RAM address
+};
+
+struct ROM_IMAGE_SECTION
+{
+    uint32_t offset;            // bytes from the start of the file
+    uint32_t count;             // entries, bytes for names
+};
+
+struct ROM_IMAGE_HEADER
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    ROM_IMAGE_SECTION words;
+    ROM_IMAGE_SECTION symbols;
+    ROM_IMAGE_SECTION names;
+    ROM_IMAGE_SECTION lines;
+};
+
+struct ROM_IMAGE_SYMBOL
+{
+    uint32_t name;              // offset into the names section
+    uint16_t value;
+    uint16_t kind;
+};
+
+static_assert(sizeof(ROM_IMAGE_HEADER) == 48 && sizeof(ROM_IMAGE_SYMBOL) == 8);
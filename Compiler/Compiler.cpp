@@ -3,7 +3,6 @@
 #include "SymbolTable.h"
 
 using namespace std;
-char* LexerLoc;
 char* GrammarLoc;
 
 void printParseTree(std::ostream& out, const ParseTreeNode* node)
@@ -25,18 +24,16 @@ void cleanParseTree(ParseTreeNode* node)
 
 int main(int argc, char** argv)
 {
-    if (argc != 5)
+    if (argc != 4)
     {
         cerr << "Invalid number of arguments!" << endl;
-        cerr << "Usage: ./compiler.out <DFA file> <Grammar file> <input_file_location> <output_bytecode_location>" << endl;
+        cerr << "Usage: ./compiler.out <Grammar file> <input_file_location> <output_bytecode_location>" << endl;
         exit(-1);
     }
 
-    LexerLoc = argv[1];
-    GrammarLoc = argv[2];
-    loadDFA();
+    GrammarLoc = argv[1];
     loadParser();
-    Buffer buffer(argv[3]);
+    Buffer buffer(argv[2]);
 
     bool error = false;
     auto parseNode = parseInputSourceCode(buffer, error);
@@ -6,6 +6,9 @@
 #include <string_view>
 using namespace std;
 
+// Emit HackX instructions (block move) where they shorten the generated code
+static bool hackx = false;
+
 void stack_writer(ASTNode* node, const string& source_file_name, std::ostream& out)
 {
     out << endl;
@@ -222,6 +225,21 @@ void call_writer(ASTNode* node, const string& source_file_name, std::ostream& ou
         out << "  AM = M + 1" << endl;
         out << "  A = A - 1" << endl;
         out << "  M = D" << endl;
+
+        if (hackx && x == ret_label)
+        {
+            // LCL, ARG, THIS and THAT are RAM[1..4], copy them in one block move
+            out << "  @LCL  // push LCL, ARG, THIS, THAT" << endl;
+            out << "  D = A" << endl;
+            out << "  @SP" << endl;
+            out << "  A = M" << endl;
+            out << "  MOVE 4" << endl;
+            out << "  @4" << endl;
+            out << "  D = A" << endl;
+            out << "  @SP" << endl;
+            out << "  M = D + M" << endl;
+            break;
+        }
     }
 
     out << "  @SP  // LCL = SP" << endl;
@@ -267,15 +285,27 @@ void return_writer(ASTNode* node, const string& source_file_name, std::ostream&
     out << "  @R15" << endl;
     out << "  M = D" << endl;
 
-    vector<string> pop_targets = {"THAT", "THIS", "ARG", "LCL"};
-    for (auto &target: pop_targets)
+    if (hackx)
     {
-        // load from lcl-1, lcl--, return popped value to target
-        out << "  @LCL  // pop " << target << " using LCL" << endl;
-        out << "  AM = M - 1" << endl;
+        out << "  @LCL  // LCL, ARG, THIS, THAT <- RAM[LCL - 4 .. LCL - 1]" << endl;
         out << "  D = M" << endl;
-        out << "  @" << target << endl;
-        out << "  M = D" << endl;
+        out << "  @4" << endl;
+        out << "  D = D - A" << endl;
+        out << "  @LCL" << endl;
+        out << "  MOVE 4" << endl;
+    }
+    else
+    {
+        vector<string> pop_targets = {"THAT", "THIS", "ARG", "LCL"};
+        for (auto &target: pop_targets)
+        {
+            // load from lcl-1, lcl--, return popped value to target
+            out << "  @LCL  // pop " << target << " using LCL" << endl;
+            out << "  AM = M - 1" << endl;
+            out << "  D = M" << endl;
+            out << "  @" << target << endl;
+            out << "  M = D" << endl;
+        }
     }
 
     // jump to return address
@@ -284,9 +314,10 @@ void return_writer(ASTNode* node, const string& source_file_name, std::ostream&
     out << "  0;JMP" << endl;
 }
 
-void writeAssembly(ASTNode* node, const string& source_file_name, std::ostream& out)
+void writeAssembly(ASTNode* node, const string& source_file_name, std::ostream& out, bool use_hackx)
 {
     assert(node);
+    hackx = use_hackx;
     out << "  // BOOTSTRAP AREA" << endl;
     out << "  // SP = 256" << endl;
     out << "  @256" << endl;
@@ -1,4 +1,4 @@
 #pragma once
 #include "SemanticAnalysis.h"
 
-void writeAssembly(ASTNode*, const std::string&, std::ostream&);
\ No newline at end of file
+void writeAssembly(ASTNode*, const std::string&, std::ostream&, bool hackx = false);
\ No newline at end of file
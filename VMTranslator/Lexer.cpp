@@ -1,10 +1,14 @@
 #include "Lexer.h"
+#include "DFA.h"
 #include <cassert>
 #include <iomanip>
 #include <sstream>
 using namespace std;
 
-DFA dfa;
+const DFA dfa{
+	{ DFA_TOKEN_NAMES.begin(), DFA_TOKEN_NAMES.end() },
+	{ DFA_KEYWORD_TOKENS.begin(), DFA_KEYWORD_TOKENS.end() },
+};
 
 std::ostream& operator<< (std::ostream& out, const Token& token)
 {
@@ -25,73 +29,6 @@ std::ostream& operator<< (std::ostream& out, const Token& token)
 	return out;
 }
 
-void loadDFA()
-{
-	std::ifstream dfaReader{ LexerLoc };
-	assert(dfaReader);
-	dfaReader >> dfa.num_tokens >> dfa.num_states >> dfa.num_transitions >> dfa.num_finalStates >> dfa.num_keywords;
-
-	// Load Tokens
-	dfa.tokenType2tokenStr.clear();
-	dfa.tokenType2tokenStr.resize(dfa.num_tokens);
-	dfa.tokenStr2tokenType.clear();
-	for (int i = 0; i < dfa.num_tokens; ++i)
-	{
-		dfaReader >> dfa.tokenType2tokenStr[i];
-		dfa.tokenStr2tokenType[dfa.tokenType2tokenStr[i]] = (TokenType)i;
-	}
-
-	// Load Transitions
-	dfa.productions.clear();
-	dfa.productions.assign(dfa.num_states, vector<int>(128, -1));
-
-	for (int i = 0; i < dfa.num_transitions; ++i)
-	{
-		int from, to;
-		string symbols;
-		dfaReader >> from >> to >> symbols;
-
-		for (char c : symbols)
-			dfa.productions[from][c] = to;
-	}
-
-	// state 4 - accept state for whitespace
-	dfa.productions[0][' ']
-		= dfa.productions[0]['\t']
-		= dfa.productions[0]['\r']
-		= dfa.productions[4][' ']
-		= dfa.productions[4]['\t']
-		= dfa.productions[4]['\r']
-		= 4;
-
-    // state 5 - accept state for new line
-    dfa.productions[0]['\n'] = 5;
-
-	// Load Final States
-	dfa.finalStates.clear();
-	dfa.finalStates.assign(dfa.num_states, TokenType::UNINITIALISED);
-
-	for (int i = 0; i < dfa.num_finalStates; i++)
-	{
-		int state;
-		string BUFF;
-		dfaReader >> state >> BUFF;
-
-		dfa.finalStates[state] = dfa.tokenStr2tokenType[BUFF];
-	}
-
-	// Load Keywords
-	dfa.lookupTable.clear();
-	dfa.keywordTokens.clear();
-	for (int i = 0; i < dfa.num_keywords; ++i)
-	{
-		string keyword, token_name;
-		dfaReader >> keyword >> token_name;
-		dfa.lookupTable[keyword] = dfa.tokenStr2tokenType[token_name];
-		dfa.keywordTokens.insert(token_name);
-	}
-}
-
 void onTokenFromDFA(Token*& token, Buffer& buffer)
 {
 	if (token->type == TokenType::TK_WHITESPACE)
@@ -101,18 +38,14 @@ void onTokenFromDFA(Token*& token, Buffer& buffer)
 		return;
 	}
 
-	char* BUFF = new char[token->length + 1];
-	for (int i = 0; i < token->length; i++)
-		BUFF[i] = buffer.getChar(buffer.start_index - token->length + i);
-	BUFF[token->length] = 0;
-	token->lexeme = BUFF;
+	token->lexeme = buffer.view(token->start_index, token->length);
 
     // Handle keyword
 	if (token->type == TokenType::TK_SYMBOL)
 	{
-		auto res = dfa.lookupTable.find(token->lexeme);
-		if (res != dfa.lookupTable.end())
-			token->type = dfa.lookupTable.at(token->lexeme);
+		TokenType keyword = lookupKeyword(token->lexeme);
+		if (keyword != TokenType::UNINITIALISED)
+			token->type = keyword;
 	}
 
 	if (token->type == TokenType::TK_SYMBOL && token->length > 30)
@@ -148,13 +81,13 @@ Token* getTokenFromDFA(Buffer& buffer)
 
 	while (1)
 	{
-		char input = buffer.getChar(start_index);
+		unsigned char input = buffer.getChar(start_index);
 
 		last_final = cur_state;
-		ttype = dfa.finalStates[cur_state];
+		ttype = DFA_FINAL[cur_state];
 		input_final_pos = start_index - 1;
 
-		cur_state = dfa.productions[cur_state][input];
+		cur_state = DFA_NEXT[cur_state][DFA_CHAR_CLASS[input]];
 
 		if (cur_state == -1)    // return
 		{
@@ -165,7 +98,7 @@ Token* getTokenFromDFA(Buffer& buffer)
 				token->length = 1;
 				return token;
 			}
-			if (dfa.finalStates[last_final] == TokenType::UNINITIALISED && last_final != 0)
+			if (DFA_FINAL[last_final] == TokenType::UNINITIALISED && last_final != 0)
 			{
 				Token* token = new Token;
 				token->type = TokenType::TK_ERROR_PATTERN;
@@ -195,13 +128,10 @@ Token* getNextToken(Buffer& buffer)
 
 		assert(token != nullptr);
 
-        if (token->type == TokenType::TK_NEWLINE)
-            buffer.line_number++;
-
 		token->start_index = buffer.start_index;
 		token->line_number = buffer.line_number;
 
-		buffer.start_index += token->length;
+		buffer.advance(token->length);
 
 		onTokenFromDFA(token, buffer);
 
@@ -1,5 +1,6 @@
 #pragma once
-#include "Buffer.h"
+#include "../Common/Buffer.h"
+#include <cassert>
 #include <fstream>
 #include <set>
 #include <string>
@@ -7,8 +8,6 @@
 #include <utility>
 #include <vector>
 
-extern char* LexerLoc;
-
 enum class TokenType
 {
     TK_PUSH,
@@ -64,28 +63,13 @@ struct Token
     }
 };
 
+// Token names and the tokens keywords map to, from the DFA.txt the lexer is generated from
 struct DFA
 {
-	int num_tokens;
-	int num_states;
-	int num_transitions;
-	int num_finalStates;
-	int num_keywords;
-
-	std::vector<std::vector<int>> productions;
-	std::vector<TokenType> finalStates;
 	std::vector<std::string> tokenType2tokenStr;
-	std::map<std::string, TokenType> tokenStr2tokenType;
-	std::map<std::string, TokenType> lookupTable;
 	std::set<std::string> keywordTokens;
-
-	DFA() : num_tokens{ 0 }, num_states{ 0 }, num_transitions{ 0 }, num_finalStates{ 0 }, num_keywords{ 0 }
-	{
-
-	}
 };
 
-extern DFA dfa;
+extern const DFA dfa;
 
-void loadDFA();
 Token* getNextToken(Buffer&);
\ No newline at end of file
@@ -3,7 +3,6 @@
 #include "Assembler.h"
 
 using namespace std;
-char* LexerLoc;
 char* GrammarLoc;
 
 void printAST(std::ostream& out, ASTNode* node, int tab = 0)
@@ -40,18 +39,24 @@ void cleanParseTree(ParseTreeNode* node)
 
 int main(int argc, char** argv)
 {
-    if (argc != 5)
+    bool hackx = false;
+    if (argc == 5 && string(argv[1]) == "--isa=hackx")
+    {
+        hackx = true;
+        argv++;
+        argc--;
+    }
+
+    if (argc != 4)
     {
         cerr << "Invalid number of arguments!" << endl;
-        cerr << "Usage: ./translator.out <DFA file> <Grammar file> <input_vm_file_location> <output_assembly_location>" << endl;
+        cerr << "Usage: ./translator.out [--isa=hackx] <Grammar file> <input_vm_file_location> <output_assembly_location>" << endl;
         exit(-1);
     }
 
-    LexerLoc = argv[1];
-    GrammarLoc = argv[2];
-    loadDFA();
+    GrammarLoc = argv[1];
     loadParser();
-    Buffer buffer(argv[3]);
+    Buffer buffer(argv[2]);
 
     bool error = false;
     auto parseNode = parseInputSourceCode(buffer, error);
@@ -82,7 +87,7 @@ int main(int argc, char** argv)
         exit(-1);
 
     // Assembly Generation
-    ofstream output_file{ argv[4] };
+    ofstream output_file{ argv[3] };
 
     if (!output_file)
     {
@@ -91,5 +96,5 @@ int main(int argc, char** argv)
     }
     cerr << endl;
     cerr << "Writing assembly output" << endl;
-    writeAssembly(astNode, buffer.file_name, output_file);
+    writeAssembly(astNode, buffer.file_name, output_file, hackx);
 }
\ No newline at end of file